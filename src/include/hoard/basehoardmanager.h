@@ -34,6 +34,8 @@
  *
  */
 
+#include <atomic>
+
 #include "heaplayers.h"
 
 namespace Hoard {
@@ -43,7 +45,9 @@ namespace Hoard {
   public:
 
     BaseHoardManager (void)
-      : _magic (0xedded00d)
+      : _magic (0xedded00d),
+	_pending (nullptr),
+	_pendingCount (0)
     {
       static_assert((SuperblockSize & (SuperblockSize - 1)) == 0,
 		    "Size of superblock must be a power of two.");
@@ -65,6 +69,32 @@ namespace Hoard {
     /// Unlock this memory manager.
     inline virtual void unlock (void) {};
 
+    /// Free any objects other threads queued on our superblocks (lock held).
+    inline virtual void drainRemoteFrees (void) {}
+
+    /// @brief Note that s has remote frees waiting (lock-free).
+    /// @note  The caller must hold s's pending mark (from a push, a
+    ///        claim, or another heap's list); we take it over.
+    /// @return the number of superblocks now waiting.
+    inline unsigned int notePendingSuperblock (SuperblockType * s) {
+      assert (s->isPending());
+      auto * head = _pending.load (std::memory_order_relaxed);
+      do {
+	s->setNextPending (head);
+      } while (!_pending.compare_exchange_weak (head, s,
+					       std::memory_order_release,
+					       std::memory_order_relaxed));
+      return _pendingCount.fetch_add (1, std::memory_order_relaxed) + 1;
+    }
+
+    /// @brief Take the list of superblocks with remote frees waiting.
+    /// @note  Each one stays marked pending until we clear the mark
+    ///        (after reading its next pointer) or pass it on.
+    inline SuperblockType * takePendingSuperblocks (void) {
+      _pendingCount.store (0, std::memory_order_relaxed);
+      return _pending.exchange (nullptr, std::memory_order_acquire);
+    }
+
     /// Return the size of an object.
     static inline size_t getSize (void * ptr) {
       SuperblockType * s = getSuperblock (ptr);
@@ -85,6 +115,12 @@ namespace Hoard {
 
     const unsigned long _magic;
 
+    /// Superblocks with remote frees waiting, linked through their headers.
+    std::atomic<SuperblockType *> _pending;
+
+    /// (Roughly) how many superblocks are on that list.
+    std::atomic<unsigned int> _pendingCount;
+
   };
 
 }
@@ -0,0 +1,162 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.emeryberger.com
+
+  Copyright (c) 1998-2018 Emery Berger
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+#ifndef HOARD_BOOTSTRAPHEAP_H
+#define HOARD_BOOTSTRAPHEAP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+#include "heaplayers.h"
+#include "systempagesize.h"
+
+namespace Hoard {
+
+  /**
+   * @class BootstrapHeap
+   * @brief Serves the (few) allocations made before the main heap is up.
+   * @note  Memory comes from one reservation of ReserveSize bytes,
+   *        mapped on first use. Once the main heap takes over, we give
+   *        back the pages we never used.
+   * @note  Objects never move or get reused; freeing one does nothing.
+   *        Each carries its size in a header, for realloc.
+   */
+
+  template <size_t ReserveSize>
+  class BootstrapHeap {
+  public:
+
+    enum { Alignment = HL::MallocInfo::Alignment };
+
+    constexpr BootstrapHeap()
+      : _start (nullptr),
+	_size (0),
+	_bump (nullptr)
+    {}
+
+    /// @return sz bytes, or null if we're out of room (or trimmed).
+    void * malloc (size_t sz) {
+      if (_size.load (std::memory_order_acquire) == 0) {
+	reserve();
+      }
+      const size_t total = Alignment + HL::align<Alignment>(sz);
+      auto * ptr = _bump.fetch_add (total, std::memory_order_relaxed);
+      if (ptr + total > _start.load (std::memory_order_relaxed) + _size.load (std::memory_order_relaxed)) {
+	return nullptr;
+      }
+      *reinterpret_cast<size_t *>(ptr) = sz;
+      return ptr + Alignment;
+    }
+
+    /// Is ptr (anywhere) in an object we handed out?
+    inline bool contains (const void * ptr) const {
+      // Read the size first: it's zero until the start is valid.
+      const auto size = _size.load (std::memory_order_acquire);
+      return ((size_t) ((const char *) ptr - _start.load (std::memory_order_relaxed)) < size);
+    }
+
+    /// @return the size of the object at ptr, capped at what's left of
+    ///         our space (in case ptr isn't the object's start).
+    size_t getSize (const void * ptr) const {
+      auto sz = *reinterpret_cast<const size_t *>((const char *) ptr - Alignment);
+      const size_t avail = _start.load (std::memory_order_relaxed) + _size.load (std::memory_order_relaxed) - (const char *) ptr;
+      return (sz < avail) ? sz : avail;
+    }
+
+    /// Give back every page we haven't used. Call once, when the main
+    /// heap takes over (after which this heap serves nothing more).
+    void trim() {
+      const auto size = _size.load (std::memory_order_acquire);
+      if (size == 0) {
+	return;
+      }
+      auto * start = _start.load (std::memory_order_relaxed);
+      // Close the heap: any request still racing us now comes up empty.
+      auto * bump = _bump.exchange (start + size);
+      const size_t used = SystemPageSize::roundUp ((size_t) (bump - start));
+      if (used >= size) {
+	return;
+      }
+      // Shrink our range first: those pages may be mapped again at once.
+      _size.store (used, std::memory_order_release);
+#if !defined(_WIN32)
+      munmap (start + used, size - used);
+#endif
+    }
+
+  private:
+
+    void reserve() {
+#if defined(_WIN32)
+      auto * ptr = reinterpret_cast<char *>(HL::MmapWrapper::map (ReserveSize));
+#else
+      int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if defined(MAP_NORESERVE)
+      // We'll use a small part of this, and give back the rest.
+      flags |= MAP_NORESERVE;
+#endif
+      auto * ptr = reinterpret_cast<char *>(mmap (nullptr, ReserveSize,
+						  PROT_READ | PROT_WRITE,
+						  flags, -1, 0));
+      if (ptr == MAP_FAILED) {
+	ptr = nullptr;
+      }
+#endif
+      if (ptr == nullptr) {
+	abort();
+      }
+      char * expected = nullptr;
+      if (_bump.compare_exchange_strong (expected, ptr)) {
+	_start.store (ptr, std::memory_order_relaxed);
+	_size.store (ReserveSize, std::memory_order_release);
+      } else {
+	// Another thread got here first; wait for it to finish.
+	HL::MmapWrapper::unmap (ptr, ReserveSize);
+	while (_size.load (std::memory_order_acquire) == 0)
+	  ;
+      }
+    }
+
+    /// Where our space starts.
+    std::atomic<char *> _start;
+
+    /// How much space we have (zero until we've reserved it).
+    std::atomic<size_t> _size;
+
+    /// The next free byte.
+    std::atomic<char *> _bump;
+
+  };
+
+}
+
+#endif
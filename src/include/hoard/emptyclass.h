@@ -53,6 +53,9 @@ namespace Hoard {
       for (auto i = 0; i <= EmptinessClasses + 1; i++) {
 	_available(i) = 0;
       }
+      for (auto i = 0; i < NumWords; i++) {
+	_occupied(i) = 0;
+      }
     }
 
     void dumpStats() {
@@ -74,12 +77,7 @@ namespace Hoard {
       if (s && 
 	  (s->getObjectsFree() == s->getTotalObjects())) {
 	// Got an empty one. Remove it.
-	_available(0) = s->getNext();
-	if (_available(0)) {
-	  _available(0)->setPrev (0);
-	}
-	s->setPrev (0);
-	s->setNext (0);
+	unlink (s, 0);
 	return s;
       }
       return 0;
@@ -88,41 +86,31 @@ namespace Hoard {
     SuperblockType * get() {
       Check<EmptyClass, MyChecker> check (this);
       // Return as empty a superblock as possible
-      // by iterating from the emptiest to the fullest available class.
-      for (auto n = 0; n < EmptinessClasses + 1; n++) {
+      // by taking one from the emptiest non-empty class.
+      for (auto n = emptiestClass(); n >= 0; n = emptiestClass()) {
 	auto * s = _available(n);
-	while (s) {
-	  assert (s->isValidSuperblock());
-	  // Got one. Remove it.
-	  _available(n) = s->getNext();
-	  if (_available(n)) {
-	    _available(n)->setPrev (0);
-	  }
-	  s->setPrev (0);
-	  s->setNext (0);
+	assert (s->isValidSuperblock());
+	// Got one. Remove it.
+	unlink (s, n);
 
 #ifndef NDEBUG
-	  // Verify that this superblock is *gone* from the lists.
-	  for (int z = 0; z < EmptinessClasses + 1; z++) {
-	    auto * p = _available(z);
-	    while (p) {
-	      assert (p != s);
-	      p = p->getNext();
-	    }
+	// Verify that this superblock is *gone* from the lists.
+	for (int z = 0; z < EmptinessClasses + 1; z++) {
+	  auto * p = _available(z);
+	  while (p) {
+	    assert (p != s);
+	    p = p->getNext();
 	  }
+	}
 #endif
 
-	  // Ensure that we return a superblock that is as free as
-	  // possible.
-	  auto cl = getFullness (s);
-	  if (cl > n) {
-	    put (s);
-	    SuperblockType * sNew = _available(n);
-	    assert (s != sNew);
-	    s = sNew;
-	  } else {
-	    return s;
-	  }
+	// Ensure that we return a superblock that is as free as
+	// possible.
+	auto cl = getFullness (s);
+	if (cl > n) {
+	  put (s);
+	} else {
+	  return s;
 	}
       }
       return 0;
@@ -148,35 +136,49 @@ namespace Hoard {
       auto cl = getFullness (s);
 
       //    printf ("put %x, cl = %d\n", s, cl);
-      s->setPrev (0);
-      s->setNext (_available(cl));
-      if (_available(cl)) {
-	_available(cl)->setPrev (s);
-      }
-      _available(cl) = s;
+      link (s, cl);
     }
 
     INLINE MALLOC_FUNCTION void * malloc (size_t sz) {
       // Malloc from the fullest superblock first.
-      for (auto i = EmptinessClasses; i >= 0; i--) {
+      auto i = fullestClass();
+      if (i >= 0) {
 	SuperblockType * s = _available(i);
-	// printf ("i\n");
-	if (s) {
-	  auto oldCl = getFullness (s);
-	  void * ptr = s->malloc (sz);
-	  auto newCl = getFullness (s);
-	  if (ptr) {
-	    if (oldCl != newCl) {
-	      transfer (s, oldCl, newCl);
-	    }
-	    assert ((size_t) ptr % SuperblockType::Alignment == 0);
-	    return ptr;
+	auto oldCl = getFullness (s);
+	void * ptr = s->malloc (sz);
+	auto newCl = getFullness (s);
+	if (ptr) {
+	  if (oldCl != newCl) {
+	    transfer (s, oldCl, newCl);
 	  }
+	  assert ((size_t) ptr % SuperblockType::Alignment == 0);
+	  return ptr;
 	}
       }
       return nullptr;
     }
 
+    /// Allocate up to n objects, again from the fullest superblocks first.
+    INLINE unsigned int mallocBatch (size_t sz, void ** ptrs, unsigned int n) {
+      Check<EmptyClass, MyChecker> check (this);
+      unsigned int count = 0;
+      while (count < n) {
+	auto i = fullestClass();
+	if (i < 0) {
+	  break;
+	}
+	SuperblockType * s = _available(i);
+	count += s->mallocBatch (sz, ptrs + count, n - count);
+	auto newCl = getFullness (s);
+	if (newCl == i) {
+	  // Still room in this superblock, so we must be done.
+	  break;
+	}
+	transfer (s, i, newCl);
+      }
+      return count;
+    }
+
     INLINE void free (void * ptr) {
       Check<EmptyClass, MyChecker> check (this);
       auto * s = getSuperblock (ptr);
@@ -197,20 +199,105 @@ namespace Hoard {
 
   private:
 
+    /// The occupancy bitmap: bit i is set iff _available(i) is non-empty.
+    typedef unsigned long long WordType;
+
+    enum { NumLists = EmptinessClasses + 2 };
+    enum { BitsPerWord = sizeof(WordType) * 8 };
+    enum { NumWords = (NumLists + BitsPerWord - 1) / BitsPerWord };
+
     void transfer (SuperblockType * s, int oldCl, int newCl)
     {
+      unlink (s, oldCl);
+      link (s, newCl);
+    }
+
+    /// Push s onto the front of list cl.
+    inline void link (SuperblockType * s, int cl) {
+      s->setNext (_available(cl));
+      s->setPrev (0);
+      if (_available(cl)) {
+	_available(cl)->setPrev (s);
+      } else {
+	_occupied(cl / BitsPerWord) |= bit (cl);
+      }
+      _available(cl) = s;
+    }
+
+    /// Remove s from list cl.
+    inline void unlink (SuperblockType * s, int cl) {
       auto * prev = s->getPrev();
       auto * next = s->getNext();
       if (prev) { prev->setNext (next); }
       if (next) { next->setPrev (prev); }
-      if (s == _available(oldCl)) {
+      if (s == _available(cl)) {
 	assert (prev == 0);
-	_available(oldCl) = next;
+	_available(cl) = next;
+	if (!next) {
+	  _occupied(cl / BitsPerWord) &= ~bit (cl);
+	}
       }
-      s->setNext (_available(newCl));
       s->setPrev (0);
-      if (_available(newCl)) { _available(newCl)->setPrev (s); }
-      _available(newCl) = s;
+      s->setNext (0);
+    }
+
+    static inline WordType bit (int cl) {
+      return (WordType) 1 << (cl % BitsPerWord);
+    }
+
+    /// The bits of word w that stand for superblocks with room in them.
+    static inline WordType notFull (int w) {
+      // The full list is the very last one.
+      return ((w == (NumLists - 1) / BitsPerWord) ? ~bit (NumLists - 1) : ~(WordType) 0);
+    }
+
+    /// @return the emptiest class holding a superblock with room, or -1.
+    inline int emptiestClass() const {
+      for (auto w = 0; w < NumWords; w++) {
+	auto bits = _occupied(w) & notFull (w);
+	if (bits) {
+	  return w * BitsPerWord + lowestBit (bits);
+	}
+      }
+      return -1;
+    }
+
+    /// @return the fullest class holding a superblock with room, or -1.
+    inline int fullestClass() const {
+      for (auto w = NumWords - 1; w >= 0; w--) {
+	auto bits = _occupied(w) & notFull (w);
+	if (bits) {
+	  return w * BitsPerWord + highestBit (bits);
+	}
+      }
+      return -1;
+    }
+
+    /// The index of the lowest set bit of v, for v > 0.
+    static inline int lowestBit (WordType v) {
+#if defined(__GNUC__)
+      return __builtin_ctzll (v);
+#else
+      int i = 0;
+      while (!(v & 1)) {
+	v >>= 1;
+	i++;
+      }
+      return i;
+#endif
+    }
+
+    /// The index of the highest set bit of v, for v > 0.
+    static inline int highestBit (WordType v) {
+#if defined(__GNUC__)
+      return (BitsPerWord - 1) - __builtin_clzll (v);
+#else
+      int i = 0;
+      while (v >>= 1) {
+	i++;
+      }
+      return i;
+#endif
     }
 
     static INLINE int getFullness (SuperblockType * s) {
@@ -251,6 +338,7 @@ namespace Hoard {
     void sanityCheck() {
       for (int i = 0; i <= EmptinessClasses + 1; i++) {
 	SuperblockType * s = _available(i);
+	assert (!s == !(_occupied(i / BitsPerWord) & bit (i)));
 	while (s) {
 	  assert (getFullness(s) == i);
 	  s = s->getNext();
@@ -262,6 +350,9 @@ namespace Hoard {
     /// @note index 0 = completely empty, EmptinessClasses + 1 = full
     Array<EmptinessClasses + 2, SuperblockType *> _available;
 
+    /// Which of the bins above are non-empty.
+    Array<NumWords, WordType> _occupied;
+
   };
 
 }
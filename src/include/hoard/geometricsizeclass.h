@@ -79,20 +79,17 @@ namespace Hoard {
 
     /// Return the size class for a given size.
     static int size2class (const size_t sz) {
-      // Do a binary search to find the right size class.
-      int left  = 0;
-      int right = NUM_SIZECLASSES - 1;
-      while (left < right) {
-	int mid = (left + right)/2;
-	if (c2s(mid) < sz) {
-	  left = mid + 1;
-	} else {
-	  right = mid;
-	}
+      // Start from the first class at or above sz's power of two;
+      // since classes grow geometrically, only a few can follow it
+      // before the next power of two.
+      const auto& t = tables();
+      int cl = t.firstClass[log2 (sz)];
+      while ((t.sizes[cl] < sz) && (cl < NUM_SIZECLASSES - 1)) {
+	cl++;
       }
-      assert (c2s(left) >= sz);
-      assert ((left == 0) || (c2s(left-1) < sz));
-      return left;
+      assert (c2s(cl) >= sz);
+      assert ((cl == 0) || (c2s(cl-1) < sz));
+      return cl;
     }
 
     /// Return the maximum size for a given size class.
@@ -137,28 +134,62 @@ namespace Hoard {
 
     /// Quickly compute the maximum size for a given size class.
     static unsigned long c2s (int cl) {
-      static size_t sizes[NUM_SIZECLASSES];
-      static bool init = createTable ((size_t *) sizes);
-      init = init;
-      return sizes[cl];
+      return tables().sizes[cl];
     }
 
-    /// Builds an array to speed size computations, stored in sizes.
-    static bool createTable (size_t * sizes)
-    {
-      const double base =
-	(1.0 + (double) MaxOverhead / (double) 100.0);
-      size_t sz = Alignment;
-      for (int i = 0; i < NUM_SIZECLASSES; i++) {
-	sizes[i] = sz;
-	size_t newSz = (size_t) (floor ((double) base * (double) sz));
-	newSz = newSz - (HL::Modulo<Alignment>::mod (newSz));
-	while ((double) newSz / (double) sz < base) {
-	  newSz += Alignment;
+    enum { NumLog2s = sizeof(size_t) * 8 };
+
+    /// The floor of log2(sz), for sz > 0 (and 0 otherwise).
+    static inline int log2 (size_t sz) {
+#if defined(__GNUC__)
+      return (sz == 0) ? 0 : (int) (sizeof(unsigned long long) * 8 - 1) - __builtin_clzll ((unsigned long long) sz);
+#else
+      int lg = 0;
+      while (sz >>= 1) {
+	lg++;
+      }
+      return lg;
+#endif
+    }
+
+    /// Tables to speed size computations.
+    class Tables {
+    public:
+
+      Tables()
+      {
+	const double base =
+	  (1.0 + (double) MaxOverhead / (double) 100.0);
+	size_t sz = Alignment;
+	for (int i = 0; i < NUM_SIZECLASSES; i++) {
+	  sizes[i] = sz;
+	  size_t newSz = (size_t) (floor ((double) base * (double) sz));
+	  newSz = newSz - (HL::Modulo<Alignment>::mod (newSz));
+	  while ((double) newSz / (double) sz < base) {
+	    newSz += Alignment;
+	  }
+	  sz = newSz;
+	}
+	// Record where each power of two starts.
+	int cl = 0;
+	for (int lg = 0; lg < NumLog2s; lg++) {
+	  while ((cl < NUM_SIZECLASSES - 1) && (sizes[cl] < ((size_t) 1 << lg))) {
+	    cl++;
+	  }
+	  firstClass[lg] = cl;
 	}
-	sz = newSz;
       }
-      return true;
+
+      /// The maximum size of each size class.
+      size_t sizes[NUM_SIZECLASSES];
+
+      /// The first size class that can hold 2^i bytes.
+      int firstClass[NumLog2s];
+    };
+
+    static const Tables& tables() {
+      static Tables t;
+      return t;
     }
 
   };
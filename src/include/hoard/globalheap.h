@@ -28,8 +28,13 @@
 #ifndef HOARD_GLOBALHEAP_H
 #define HOARD_GLOBALHEAP_H
 
+#include <atomic>
+
+#include "hoardconstants.h"
 #include "hoardsuperblock.h"
+#include "numatopology.h"
 #include "processheap.h"
+#include "purgepolicy.h"
 
 namespace Hoard {
 
@@ -37,55 +42,103 @@ namespace Hoard {
 	    template <class LockType_,
 		      int SuperblockSize_,
 		      typename HeapType_> class Header_,
-	    int EmptinessClasses,
-	    class MmapSource,
 	    class LockType>
   class GlobalHeap {
-  
-    class bogusThresholdFunctionClass {
-    public:
-      static inline bool function (unsigned int, unsigned int, size_t) {
-	// We *never* cross the threshold for the global heap, since
-	// it is the "top."
-	return false;
-      }
-    };
-  
   public:
 
     GlobalHeap() 
-      : _theHeap (getHeap())
     {
+      getHeap (0);
     }
   
-    typedef ProcessHeap<SuperblockSize, Header_, EmptinessClasses, LockType, bogusThresholdFunctionClass, MmapSource> SuperHeap;
+    typedef ProcessHeap<SuperblockSize, Header_, LockType> SuperHeap;
     typedef HoardSuperblock<LockType, SuperblockSize, GlobalHeap, Header_> SuperblockType;
   
     void put (void * s, size_t sz) {
       assert (s);
       assert (((SuperblockType *) s)->isValidSuperblock());
-      _theHeap->put ((typename SuperHeap::SuperblockType *) s,
-		     sz);
+      // Send it home, to the heap for its memory node.
+      auto node = ((SuperblockType *) s)->getNode();
+      getHeap (node)->put ((typename SuperHeap::SuperblockType *) s,
+			   sz);
     }
 
     SuperblockType * get (size_t sz, void * dest) {
+      // Only reuse superblocks from our own memory node; if there
+      // are none, the caller makes a fresh (local) one instead.
       auto * s = 
 	reinterpret_cast<SuperblockType *>
-	(_theHeap->get (sz, reinterpret_cast<SuperHeap *>(dest)));
+	(getHeap (NUMATopology::getCurrentNode())->get (sz, reinterpret_cast<SuperHeap *>(dest)));
       if (s) {
 	assert (s->isValidSuperblock());
       }
+      // We only get here on the malloc slow path, but with the
+      // caller's heap locked: if a purge pass is due, leave it for
+      // that thread to run once it lets go (see purgeIfRequested).
+      if (PurgePolicy::isDue (PurgePolicy::now())) {
+	purgeRequested().store (true, std::memory_order_relaxed);
+      }
       return s;
     }
 
+    /// @brief Run the purge pass that get() found due, if any.
+    /// @note  Callers must not hold any locks.
+    static inline void purgeIfRequested() {
+      if (purgeRequested().load (std::memory_order_relaxed) &&
+	  purgeRequested().exchange (false, std::memory_order_relaxed)) {
+	purgeExpired();
+      }
+    }
+
+    /// Give back superblocks that have been empty for at least age ms.
+    static void purge (unsigned long age) {
+      purgeAll (PurgePolicy::now(), age);
+    }
+
+    /// Give back superblocks that have been empty for the purge delay.
+    static void purgeExpired() {
+      auto delay = PurgePolicy::getDelay();
+      if (delay >= 0) {
+	purge ((unsigned long) delay);
+      }
+    }
+
   private:
 
-    SuperHeap * _theHeap;
+    /// Has get() found a purge pass due?
+    static inline std::atomic<bool>& purgeRequested() {
+      static std::atomic<bool> r (false);
+      return r;
+    }
+
+    static void purgeAll (unsigned long now, unsigned long age) {
+      for (auto node = 0; node < NUMATopology::getNumNodes(); node++) {
+	getHeap (node)->purge (now, age);
+      }
+    }
+
+    /// One heap per memory node.
+    class NodeHeaps {
+    public:
+      NodeHeaps() {
+	for (auto node = 0; node < NUMATopology::getNumNodes(); node++) {
+	  new (&_buf[node][0]) SuperHeap;
+	}
+      }
+
+      inline SuperHeap * get (int node) {
+	return reinterpret_cast<SuperHeap *>(&_buf[node][0]);
+      }
+
+    private:
+      double _buf[MaxNUMANodes][sizeof(SuperHeap) / sizeof(double) + 1];
+    };
 
-    inline static SuperHeap * getHeap (void) {
-      static double theHeapBuf[sizeof(SuperHeap) / sizeof(double) + 1];
-      static auto * theHeap = new (&theHeapBuf[0]) SuperHeap;
-      return theHeap;
+    inline static SuperHeap * getHeap (int node) {
+      assert ((node >= 0) && (node < NUMATopology::getNumNodes()));
+      static double theHeapsBuf[sizeof(NodeHeaps) / sizeof(double) + 1];
+      static auto * theHeaps = new (&theHeapsBuf[0]) NodeHeaps;
+      return theHeaps->get (node);
     }
 
     // Prevent copying.
@@ -28,16 +28,25 @@
 #ifndef HOARD_HEAPMANAGER_H
 #define HOARD_HEAPMANAGER_H
 
-#include <cstdlib>
-#include <mutex>
+#include <atomic>
 
+#include "array.h"
 #include "hoardconstants.h"
 #include "heaplayers.h"
 
 namespace Hoard {
 
-  template <typename LockType,
-	    typename HeapType>
+  /**
+   * @class HeapManager
+   * @brief Assigns threads to heaps, without locks.
+   * @note  Each heap counts the threads using it. A new thread takes an
+   *        idle heap, or failing that, the least loaded one: the one
+   *        with the fewest threads, and of those, the one whose lock
+   *        has lately been the least contended. Threads that keep
+   *        waiting on a shared heap's lock spread out to quieter heaps.
+   */
+
+  template <typename HeapType>
   class HeapManager : public HeapType {
   public:
 
@@ -45,79 +54,109 @@ namespace Hoard {
 
     HeapManager()
     {
-      std::lock_guard<LockType> g (heapLock);
-      
       /// Initialize all heap maps (nothing yet assigned).
-      for (auto i = 0; i < HeapType::MaxThreads; i++) {
-	HeapType::setTidMap (i, 0);
-      }
       for (auto i = 0; i < HeapType::MaxHeaps; i++) {
 	HeapType::setInusemap (i, 0);
+	_contentionSeen(i).store (0, std::memory_order_relaxed);
       }
+      // Whoever constructs us (normally the main thread) uses heap 0.
+      HeapType::setInusemap (0, 1);
     }
 
     /// Set this thread's heap id to 0.
     void chooseZero() {
-      std::lock_guard<LockType> g (heapLock);
-      HeapType::setTidMap (HL::CPUInfo::getThreadId() % Hoard::MaxThreads, 0);
+      HeapType::setThreadHeap (0);
     }
 
     int findUnusedHeap() {
-
-      std::lock_guard<LockType> g (heapLock);
-      
-      auto tid_original = HL::CPUInfo::getThreadId();
-      auto tid = tid_original % HeapType::MaxThreads;
-      
-      int i = 0;
-      while ((i < HeapType::MaxHeaps) && (HeapType::getInusemap(i)))
-	i++;
-      if (i >= HeapType::MaxHeaps) {
-	// Every heap is in use: pick a random heap.
-#if defined(_WIN32)
-	auto randomNumber = rand();
-#else
-	auto randomNumber = (int) lrand48();
-#endif
-	i = randomNumber % HeapType::MaxHeaps;
+      for (;;) {
+	auto users = 0;
+	auto i = leastLoadedHeap (users);
+	// Claiming fails if someone else got there first: look again.
+	if (HeapType::claimHeap (i, users)) {
+	  HeapType::setThreadHeap (i);
+	  return i;
+	}
       }
+    }
 
-      HeapType::setInusemap (i, 1);
-      HeapType::setTidMap ((int) tid, i);
-      
-      return i;
+    /// Return surplus memory from the per-thread heaps to the global heap.
+    void scavenge() {
+      HeapType::scavenge();
     }
 
     void releaseHeap() {
-      // Decrement the ref-count on the current heap.
-      
-      std::lock_guard<LockType> g (heapLock);
-      
       // Statically ensure that the number of threads is a power of two.
       enum { VerifyPowerOfTwo = 1 / ((HeapType::MaxThreads & ~(HeapType::MaxThreads-1))) };
-      
-      auto tid = (int) (HL::CPUInfo::getThreadId() & (HeapType::MaxThreads - 1));
-      auto heapIndex = HeapType::getTidMap (tid);
-      
-      HeapType::setInusemap (heapIndex, 0);
-      
-      // Prevent underruns (defensive programming).
-      
-      if (HeapType::getInusemap (heapIndex) < 0) {
-	HeapType::setInusemap (heapIndex, 0);
+
+      HeapType::unclaimHeap (HeapType::getThreadHeap());
+    }
+
+    inline unsigned int mallocBatch (size_t sz, void ** ptrs, unsigned int n) {
+      // Refills are a cheap place to check on this thread's heap.
+      auto i = HeapType::getThreadHeap();
+      if (recentContention (i) >= RebalanceContention) {
+	rebalance (i);
       }
+      return HeapType::mallocBatch (sz, ptrs, n);
     }
     
-    
   private:
     
     // Disable copying.
     
     HeapManager (const HeapManager&);
     HeapManager& operator= (const HeapManager&);
-    
-    /// The lock, to ensure mutual exclusion.
-    LockType heapLock;
+
+    /// How often heap i's lock has been contended since we last acted on it.
+    unsigned int recentContention (int i) const {
+      return HeapType::getContention (i) - _contentionSeen(i).load (std::memory_order_relaxed);
+    }
+
+    /// @brief Find the first idle heap, or else the least loaded one.
+    /// @param users  Set to the number of threads using that heap.
+    int leastLoadedHeap (int& users) const {
+      auto best = 0;
+      users = HeapType::getInusemap (0);
+      for (auto i = 0; (i < HeapType::getNumHeaps()) && (users > 0); i++) {
+	auto u = HeapType::getInusemap (i);
+	if ((u < users) ||
+	    ((u == users) && (recentContention (i) < recentContention (best)))) {
+	  best = i;
+	  users = u;
+	}
+      }
+      return best;
+    }
+
+    /// The calling thread keeps waiting for heap i: move it somewhere
+    /// quieter, if there is such a place.
+    NO_INLINE void rebalance (int i) {
+      // Only the first thread to notice acts on this contention.
+      auto seen = _contentionSeen(i).load (std::memory_order_relaxed);
+      auto now = HeapType::getContention (i);
+      if ((now - seen < RebalanceContention) ||
+	  !_contentionSeen(i).compare_exchange_strong (seen, now, std::memory_order_relaxed)) {
+	return;
+      }
+      auto current = HeapType::getInusemap (i);
+      if (current <= 1) {
+	// Nobody to get away from (it's remote frees that contend).
+	return;
+      }
+      auto users = 0;
+      auto j = leastLoadedHeap (users);
+      if ((users < current - 1) && HeapType::claimHeap (j, users)) {
+	// The memory we got from heap i stays there; frees find it.
+	HeapType::setThreadHeap (j);
+	HeapType::unclaimHeap (i);
+      }
+    }
+
+    /// @brief Each heap's lock contention count, as of our last look.
+    /// @note  Same width as the counts themselves, so differences
+    ///        stay right when they wrap around.
+    Array<HeapType::MaxHeaps, std::atomic<unsigned int> > _contentionSeen;
   };
 
 }
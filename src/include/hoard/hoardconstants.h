@@ -29,6 +29,8 @@
 #ifndef HOARD_HOARDCONSTANTS_H
 #define HOARD_HOARDCONSTANTS_H
 
+#include <cstddef>
+
 namespace Hoard {
   
   /// The maximum amount of memory that each TLAB may hold, in bytes.
@@ -39,10 +41,91 @@ namespace Hoard {
   
   /// The maximum number of heaps supported.
   enum { NumHeaps = 128 };
+
+  /// The number of per-CPU caches (when built with HOARD_PER_CPU_CACHE).
+  enum { MaxCPUs = 256 };
+
+  /// The maximum number of NUMA memory nodes (each gets its own global heap).
+  enum { MaxNUMANodes = 8 };
+
+  /// The size of the regions superblocks are carved from when built
+  /// with HOARD_HUGE_PAGES (the x86-64 transparent huge page size).
+  enum { HugePageSize = 2 * 1024 * 1024UL };
   
+  /// How much address space, in bytes, we reserve at a time for
+  /// superblocks (64GB where we have the room).
+  enum { SuperblockReserveSize = (sizeof(void *) == 8) ? ((size_t) 64 << 30) : ((size_t) 256 << 20) };
+
+  /// How much of that reservation, in bytes, we make usable at a time.
+  enum { SuperblockCommitSize = 1024 * 1024UL }; // 1MB
+
   /// Size, in bytes, of the largest object we will cache on a
-  /// thread-local allocation buffer.
+  /// thread-local allocation buffer from the start. Bigger size
+  /// classes (up to BigObjectSize) are cached once they turn hot.
   enum { LargestSmallObject = 256UL };
+
+  /// Starting budget, in bytes, of each cached TLAB size class.
+  enum { InitialBytesPerTLABClass = 64 * 1024UL };
+
+  /// Bounds on the adaptive budget of each cached TLAB size class.
+  enum { MinBytesPerTLABClass = 16 * 1024UL };
+  enum { MaxBytesPerTLABClass = 512 * 1024UL };
+
+  /// The number of TLAB misses after which an uncached size class turns hot.
+  enum { HotClassMisses = 64 };
+
+  /// The most objects a TLAB fetches from its parent heap in one refill.
+  enum { MaxObjectsPerRefill = 32 };
+
+  /// The most memory, in bytes, a TLAB fetches in one refill.
+  enum { MaxBytesPerRefill = 8192 };
+
+  /// The most objects a TLAB returns to its parent heap in one flush.
+  enum { MaxObjectsPerFlush = 64 };
+
+  /// How many other heaps a TLAB holds back freed objects for at once
+  /// (returning them to their owner a batch at a time).
+  enum { RemoteOwnersPerTLAB = 4 };
+
+  /// How many superblocks a TLAB remembers its heap owning, so sized
+  /// frees can skip reading their headers (must be a power of two).
+  enum { OwnedSuperblocksPerTLAB = 64 };
+
+  /// How many times threads must wait for a heap's lock before one of
+  /// the threads sharing it moves to a less loaded heap.
+  enum { RebalanceContention = 256 };
+
+  /// The largest object, in bytes, a thread keeps for reuse when freed.
+  enum { LargestCachedLargeObject = 1024 * 1024UL }; // 1MB
+
+  /// The most memory, in bytes, each thread keeps in freed large objects.
+  enum { MaxBytesPerLargeObjectCache = 4 * 1024 * 1024UL }; // 4MB
+
+  /// The most cached large blocks one large malloc or free returns to the OS.
+  enum { MaxBigBlocksReleasedPerCall = 2 };
+
+  /// How often, in milliseconds, the big heap halves the memory it
+  /// keeps cached for a past peak.
+  enum { BigHeapDecayMs = 1000 };
+
+  /// How long, in milliseconds, a superblock sits empty in the global
+  /// heap before we give its memory back to the OS.
+  enum { DefaultPurgeDelayMs = 10000 };
+
+  /// How many purge passes to run per purge delay.
+  enum { PurgePassesPerDelay = 4 };
+
+  /// The smallest page size we support. The real one is only known at
+  /// run time (see SystemPageSize), and may be larger.
+  enum { PageSize = 4096UL };
+
+  /// How many groups, by fullness, the global heap keeps superblocks
+  /// of each size class in.
+  enum { GlobalHeapFullnessGroups = 4 };
+
+  /// How many superblocks with remote frees a heap may leave waiting
+  /// before a freeing thread drains them on its behalf.
+  enum { MaxPendingSuperblocks = 32 };
     
 }
 
@@ -39,12 +39,23 @@ using namespace HL;
 #define SUPERBLOCK_SIZE 65536
 
 // The number of 'emptiness classes'; see the ASPLOS paper for details.
-#define EMPTINESS_CLASSES 8
+// Finding a class is constant-time, so finer tracking costs little.
+#ifndef EMPTINESS_CLASSES
+#define EMPTINESS_CLASSES 32
+#endif
+
+// By default, a heap releases superblocks once it is less than
+// (EMPTINESS_FRACTION-1)/EMPTINESS_FRACTION full.
+// (See thresholdpolicy.h for how to change this at run time.)
+#ifndef EMPTINESS_FRACTION
+#define EMPTINESS_FRACTION 8
+#endif
 
 
 // Hoard-specific layers
 
 #include "thresholdheap.h"
+#include "thresholdpolicy.h"
 #include "hoardmanager.h"
 #include "addheaderheap.h"
 #include "threadpoolheap.h"
@@ -57,26 +68,44 @@ using namespace HL;
 #include "alignedsuperblockheap.h"
 #include "alignedmmap.h"
 #include "globalheap.h"
+#include "futexlock.h"
+#include "mcslock.h"
 
 #include "thresholdsegheap.h"
+#include "stripedheap.h"
 #include "geometricsizeclass.h"
+#include "sizeclasses.h"
 
 // Note from Emery Berger: I plan to eventually eliminate the use of
 // the spin lock, since the right place to do locking is in an
 // OS-supplied library, and platforms have substantially improved the
 // efficiency of these primitives.
 
+// TheLockType guards each heap (and superblock); TheSharedLockType
+// guards what any thread may use, like the large-object heaps. On
+// Linux, heap locks spin briefly and then sleep, and shared locks are
+// fair queue locks, so threads that get descheduled (with more
+// runnable threads than CPUs, or under a CPU quota) don't leave the
+// rest spinning. Build with HOARD_SPIN_LOCKS=1 to just spin instead.
+
 #if defined(_WIN32)
 typedef HL::WinLockType TheLockType;
+typedef HL::WinLockType TheSharedLockType;
 #elif defined(__APPLE__)
 // NOTE: On older versions of the Mac OS, Hoard CANNOT use Posix locks,
 // since they may call malloc themselves. However, as of Snow Leopard,
 // that problem seems to have gone away. Nonetheless, we use Mac-specific locks.
 typedef HL::MacLockType TheLockType;
+typedef HL::MacLockType TheSharedLockType;
 #elif defined(__SVR4)
 typedef HL::SpinLockType TheLockType;
+typedef HL::SpinLockType TheSharedLockType;
+#elif defined(__linux__) && !HOARD_SPIN_LOCKS
+typedef Hoard::FutexLock TheLockType;
+typedef Hoard::MCSLock TheSharedLockType;
 #else
 typedef HL::SpinLockType TheLockType;
+typedef HL::SpinLockType TheSharedLockType;
 #endif
 
 #if defined(__clang__)
@@ -86,13 +115,13 @@ typedef HL::SpinLockType TheLockType;
 
 namespace Hoard {
 
-  class MmapSource : public AlignedMmap<SUPERBLOCK_SIZE, TheLockType> {};
+  class MmapSource : public AlignedMmap<SUPERBLOCK_SIZE> {};
   
   //
   // There is just one "global" heap, shared by all of the per-process heaps.
   //
 
-  typedef GlobalHeap<SUPERBLOCK_SIZE, HoardSuperblockHeader, EMPTINESS_CLASSES, MmapSource, TheLockType>
+  typedef GlobalHeap<SUPERBLOCK_SIZE, HoardSuperblockHeader, TheLockType>
   TheGlobalHeap;
   
   //
@@ -101,20 +130,27 @@ namespace Hoard {
   // moves a (nearly or completely empty) superblock to the global heap.
   //
 
+  typedef ThresholdPolicy<HoardSizeClasses<SUPERBLOCK_SIZE>,
+			  SUPERBLOCK_SIZE,
+			  EMPTINESS_FRACTION,
+			  2>
+  TheThresholdPolicy;
+
   class hoardThresholdFunctionClass {
   public:
     inline static bool function (unsigned int u,
 				 unsigned int a,
-				 size_t objSize)
+				 size_t objSize,
+				 size_t heldBytes)
     {
       /*
-	Returns 1 iff we've crossed the emptiness threshold:
+	Returns 1 iff we've crossed the emptiness threshold, by default:
 	
-	U < A - 2S   &&   U < EMPTINESS_CLASSES-1/EMPTINESS_CLASSES * A
+	U < A - 2S   &&   U < EMPTINESS_FRACTION-1/EMPTINESS_FRACTION * A
 	
+	or if the heap holds more than the (optional) retention cap.
       */
-      auto r = ((EMPTINESS_CLASSES * u) < ((EMPTINESS_CLASSES-1) * a)) && ((u < a - (2 * SUPERBLOCK_SIZE) / objSize));
-      return r;
+      return TheThresholdPolicy::getInstance().crossed (u, a, objSize, heldBytes);
     }
   };
   
@@ -148,6 +184,14 @@ namespace Hoard {
 
   // The heap that manages large objects.
 
+  // Where large objects come from (each gets its own mapping).
+  class objectSource : public AddHeaderHeap<BigSuperblockType,
+					    SUPERBLOCK_SIZE,
+					    MmapSource> {};
+
+  // How many size classes of large objects the big heap caches.
+  enum { NumBigObjectClasses = 80 };
+
 #if 0
 
   // Old version: slow and now deprecated. Returns every large object
@@ -164,26 +208,71 @@ namespace Hoard {
   // than the above (around 400x in some tests).  Keeps the amount of
   // retained memory at no more than X% more than currently allocated.
 
-  class objectSource : public AddHeaderHeap<BigSuperblockType,
-					    SUPERBLOCK_SIZE,
-					    MmapSource> {};
-
-  typedef HL::ThreadHeap<64, HL::LockedHeap<TheLockType,
-					    ThresholdSegHeap<25,      // % waste
-							     1048576, // at least 1MB in any heap
-							     80,      // num size classes
-							     GeometricSizeClass<20>::size2class,
-							     GeometricSizeClass<20>::class2size,
-							     GeometricSizeClass<20>::MaxObjectSize,
-							     AdaptHeap<DLList, objectSource>,
-							     objectSource> > >
+  // Any thread may land on any stripe, and a stripe's holder may be
+  // busy remapping, so stripes take the fair shared lock.
+  typedef StripedHeap<64, TheSharedLockType,
+		      ThresholdSegHeap<25,      // % waste
+				       1048576, // at least 1MB in any heap
+				       NumBigObjectClasses,
+				       GeometricSizeClass<20>::size2class,
+				       GeometricSizeClass<20>::class2size,
+				       GeometricSizeClass<20>::MaxObjectSize,
+				       AdaptHeap<DLList, objectSource>,
+				       objectSource> >
   bigHeapType;
 #endif
 
-  class BigHeap : public bigHeapType {};
+  class BigHeap {
+  public:
+
+    enum { Alignment = bigHeapType::Alignment };
+
+    void * malloc (size_t sz) {
+      return getInstance().malloc (sz);
+    }
+
+    void free (void * ptr) {
+      getInstance().free (ptr);
+    }
+
+    size_t getSize (void * ptr) {
+      return getInstance().getSize (ptr);
+    }
+
+    /// @brief Grow or shrink a large object without copying it.
+    /// @return its (possibly new) address, or null if it must be copied.
+    static void * resize (void * ptr, size_t sz) {
+      // Keep sizes exact for the classes the segregated heaps cache.
+      if (sz < (size_t) GeometricSizeClass<20>::MaxObjectSize) {
+	auto cl = GeometricSizeClass<20>::size2class (sz);
+	if (cl < NumBigObjectClasses) {
+	  sz = GeometricSizeClass<20>::class2size (cl);
+	}
+      }
+      return getInstance().resize (ptr, sz);
+    }
+
+    /// Give back cached large objects beyond what recent use calls for.
+    static void scavenge() {
+      getInstance().scavenge();
+    }
+
+    /// Give back every cached large object.
+    static void clear() {
+      getInstance().clear();
+    }
+
+  private:
+
+    /// The one set of large-object heaps (so resize can reach them).
+    static bigHeapType& getInstance() {
+      static double buf[sizeof(bigHeapType) / sizeof(double) + 1];
+      static auto * heap = new (buf) bigHeapType;
+      return *heap;
+    }
+  };
 
-  enum { BigObjectSize = 
-	 HL::bins<SmallSuperblockType::Header, SUPERBLOCK_SIZE>::BIG_OBJECT };
+  enum { BigObjectSize = HoardSizeClasses<SUPERBLOCK_SIZE>::BIG_OBJECT };
 
   //
   // Each thread has its own heap for small objects.
@@ -206,7 +295,8 @@ namespace Hoard {
     IgnoreInvalidFree<
       HL::HybridHeap<Hoard::BigObjectSize,
 		     ThreadPoolHeap<N, NH, Hoard::PerThreadHoardHeap>,
-		     Hoard::BigHeap> > >
+		     Hoard::BigHeap>,
+      MmapSource::PageMapType> >
   {
   public:
     
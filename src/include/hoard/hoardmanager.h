@@ -39,6 +39,8 @@
 #include "manageonesuperblock.h"
 #include "basehoardmanager.h"
 #include "emptyhoardmanager.h"
+#include "numatopology.h"
+#include "sizeclasses.h"
 
 
 #include "heaplayers.h"
@@ -69,9 +71,8 @@ namespace Hoard {
 
     HoardManager()
       : _magic (MAGIC_NUMBER),
-	_cachedSize (binType::getClassSize(0)),
-	_cachedRealSize (_cachedSize),
-	_cachedSizeClass (0)
+	_active (false),
+	_heldBytes (0)
     {}
 
     virtual ~HoardManager() {}
@@ -84,19 +85,10 @@ namespace Hoard {
     MALLOC_FUNCTION INLINE void * malloc (size_t sz)
     {
       Check<HoardManager, sanityCheck> check (this);
-      int binIndex;
-      size_t realSize;
-      if (false) { // sz == _cachedSize) {
-	binIndex = _cachedSizeClass;
-	realSize = _cachedRealSize;
-      } else {
-	binIndex = binType::getSizeClass(sz);
-	realSize = binType::getClassSize (binIndex);
-	_cachedSize = sz;
-	_cachedSizeClass = binIndex;
-	_cachedRealSize = realSize;
-      }
+      const auto binIndex = binType::getSizeClass (sz);
+      const auto realSize = binType::getClassSize (binIndex);
       assert (realSize >= sz);
+      _active = true;
 
       // Iterate until we succeed in allocating memory.
       auto ptr = getObject (binIndex, realSize);
@@ -109,6 +101,35 @@ namespace Hoard {
     }
 
 
+    /// @brief Allocate up to n objects of size sz in one go.
+    /// @return The number of objects stored in ptrs.
+    /// @note  Meant for callers that already hold the lock (e.g., LockMallocHeap).
+    NO_INLINE unsigned int mallocBatch (size_t sz, void ** ptrs, unsigned int n)
+    {
+      Check<HoardManager, sanityCheck> check (this);
+      const auto binIndex = binType::getSizeClass (sz);
+      const auto realSize = binType::getClassSize (binIndex);
+      assert (realSize >= sz);
+      _active = true;
+      unsigned int count;
+      auto drained = false;
+      while ((count = _otherBins(binIndex).mallocBatch (realSize, ptrs, n)) == 0) {
+	// This bin is dry. First reclaim what other threads freed;
+	// failing that, get another superblock and try again.
+	// (As in slowPathMalloc, the parent may hand us a full one.)
+	if (!drained) {
+	  drained = true;
+	  drainRemoteFrees();
+	} else if (!getAnotherSuperblock (realSize)) {
+	  return 0;
+	}
+      }
+      auto u = _stats(binIndex).getInUse();
+      _stats(binIndex).setInUse (u + count);
+      return count;
+    }
+
+
     /// Put a superblock on this heap.
     NO_INLINE void put (SuperblockType * s, size_t sz) {
       std::lock_guard<LockType> l (_theLock);
@@ -123,7 +144,7 @@ namespace Hoard {
       auto a = stats.getAllocated() + s->getTotalObjects();
       auto u = stats.getInUse() + (s->getTotalObjects() - s->getObjectsFree());
 
-      if (thresholdFunctionClass::function (u, a, sz)) {
+      if (thresholdFunctionClass::function (u, a, sz, _heldBytes + SuperblockSize)) {
 	// We've crossed the threshold function,
 	// so we move this superblock up to the parent.
 	_ph.put (reinterpret_cast<typename ParentHeap::SuperblockType *>(s), sz);
@@ -137,6 +158,8 @@ namespace Hoard {
     NO_INLINE SuperblockType * get (size_t sz, HeapType * dest) {
       std::lock_guard<LockType> l (_theLock);
       Check<HoardManager, sanityCheck> check (this);
+      // Catch up on remote frees, so we hand out the emptiest superblock.
+      drainRemoteFrees();
       const auto binIndex = binType::getSizeClass (sz);
       auto * s = _otherBins(binIndex).get();
       if (s) {
@@ -180,13 +203,60 @@ namespace Hoard {
 
       // Free up a superblock if we've crossed the emptiness threshold.
 
-      if (thresholdFunctionClass::function (u, a, sz)) {
+      if (thresholdFunctionClass::function (u, a, sz, _heldBytes)) {
 
 	slowPathFree (binIndex, u, a);
 
       }
     }
 
+    /// @brief Give surplus superblocks back to the parent heap.
+    /// @note  Empty ones always go; if no one has allocated from this
+    ///        heap since the last scavenge, so does every superblock
+    ///        that isn't full. Meant for callers that hold the lock.
+    NO_INLINE void scavenge() {
+      Check<HoardManager, sanityCheck> check (this);
+      drainRemoteFrees();
+      const auto idle = !_active;
+      _active = false;
+      for (auto binIndex = 0; binIndex < NumBins; binIndex++) {
+	auto& bin = _otherBins(binIndex);
+	const auto sz = binType::getClassSize (binIndex);
+	if (idle) {
+	  bin.putCurrent();
+	}
+	for (;;) {
+	  auto * s = idle ? bin.get() : bin.getEmpty();
+	  if (!s) {
+	    break;
+	  }
+	  assert (s->isValidSuperblock());
+	  decStatsSuperblock (s, binIndex);
+	  _ph.put (reinterpret_cast<typename ParentHeap::SuperblockType *>(s), sz);
+	}
+      }
+    }
+
+    /// @brief Free the objects that other threads queued on our superblocks.
+    /// @note  Call with the lock held.
+    NO_INLINE void drainRemoteFrees() {
+      Check<HoardManager, sanityCheck> check (this);
+      auto * s = SuperHeap::takePendingSuperblocks();
+      while (s) {
+	// Read this first: once unmarked, s may be queued again at once.
+	auto * next = s->getNextPending();
+	auto * owner = reinterpret_cast<SuperHeap *>(s->getOwner());
+	if (owner == this) {
+	  drainSuperblock (s);
+	} else {
+	  // It has moved on since: pass the news (and the pending mark)
+	  // along to its new owner.
+	  owner->notePendingSuperblock (s);
+	}
+	s = next;
+      }
+    }
+
     INLINE void lock() {
       _theLock.lock();
     }
@@ -195,10 +265,26 @@ namespace Hoard {
       _theLock.unlock();
     }
 
+    /// How many times threads have had to wait for this heap's lock
+    /// (always 0 if the lock type doesn't keep count).
+    unsigned int getContention() const {
+      return contentionOf (_theLock, 0);
+    }
+
   private:
 
     typedef BaseHoardManager<SuperblockType_> SuperHeap;
 
+    template <class L>
+    static auto contentionOf (const L& l, int) -> decltype ((unsigned int) l.contentions()) {
+      return l.contentions();
+    }
+
+    template <class L>
+    static unsigned int contentionOf (const L&, long) {
+      return 0;
+    }
+
     enum { SuperblockSize = sizeof(SuperblockType_) };
 
     /// Ensure that the superblock size is a power of two.
@@ -210,9 +296,11 @@ namespace Hoard {
     /// A magic number used for debugging.
     const unsigned long _magic;
 
-    size_t _cachedSize;
-    size_t _cachedRealSize;
-    int    _cachedSizeClass;
+    /// Has anyone allocated from this heap since the last scavenge?
+    bool _active;
+
+    /// The total size of the superblocks this heap holds.
+    size_t _heldBytes;
     
     inline int isValid() const {
       return (_magic == MAGIC_NUMBER);
@@ -223,7 +311,7 @@ namespace Hoard {
 
 
     /// The type of the bin manager.
-    typedef HL::bins<typename SuperblockType::Header, SuperblockSize> binType;
+    typedef HoardSizeClasses<SuperblockSize> binType;
 
     /// How many bins do we need to maintain?
     enum { NumBins = binType::NUM_BINS };
@@ -246,12 +334,14 @@ namespace Hoard {
 	auto totalObjects = sb->getTotalObjects();
 	stats.setInUse (u - (totalObjects - sb->getObjectsFree()));
 	stats.setAllocated (a - totalObjects);
+	_heldBytes -= SuperblockSize;
 
 	// Give it to the parent heap.
 	///////// NOTE: We change the superblock type here!
 	///////// THIS HAD BETTER BE SAFE!
-	_ph.put (reinterpret_cast<typename ParentHeap::SuperblockType *>(sb), sz);
+	// (Once it's there, it may be purged at any time.)
 	assert (sb->isValidSuperblock());
+	_ph.put (reinterpret_cast<typename ParentHeap::SuperblockType *>(sb), sz);
 
       }
     }
@@ -285,6 +375,7 @@ namespace Hoard {
       auto totalObjects = s->getTotalObjects();
       stats.setInUse (u + (totalObjects - s->getObjectsFree()));
       stats.setAllocated (a + totalObjects);
+      _heldBytes += SuperblockSize;
     }
 
 
@@ -295,17 +386,59 @@ namespace Hoard {
       auto totalObjects = s->getTotalObjects();
       stats.setInUse (u - (totalObjects - s->getObjectsFree()));
       stats.setAllocated (a - totalObjects);
+      _heldBytes -= SuperblockSize;
+    }
+
+    /// @brief Free every object queued on a superblock we own by
+    ///        remote frees, once it's off our pending list.
+    void drainSuperblock (SuperblockType * s) {
+      auto * ptr = s->takePendingRemoteFrees();
+      if (!ptr) {
+	return;
+      }
+      const auto sz = s->getObjectSize();
+      const auto binIndex = binType::getSizeClass (sz);
+      auto& bin = _otherBins(binIndex);
+      unsigned int count = 0;
+      while (ptr) {
+	auto * next = *reinterpret_cast<void **>(ptr);
+	bin.free (ptr);
+	count++;
+	ptr = next;
+      }
+
+      // Update statistics, once for the lot.
+      auto& stats = _stats(binIndex);
+      auto u = stats.getInUse() - count;
+      stats.setInUse (u);
+
+      // Free up superblocks while we're past the emptiness threshold.
+      auto a = stats.getAllocated();
+      while ((a > 0) && thresholdFunctionClass::function (u, a, sz, _heldBytes)) {
+	slowPathFree (binIndex, u, a);
+	if (stats.getAllocated() == a) {
+	  // Nothing left to give.
+	  break;
+	}
+	u = stats.getInUse();
+	a = stats.getAllocated();
+      }
     }
 
     MALLOC_FUNCTION NO_INLINE void * slowPathMalloc (size_t sz) {
       auto binIndex = binType::getSizeClass (sz);
       auto realSize = binType::getClassSize (binIndex);
       assert (realSize >= sz);
+      auto drained = false;
       for (;;) {
 	Check<HoardManager, sanityCheck> check1 (this);
 	auto * ptr = getObject (binIndex, realSize);
 	if (ptr) {
 	  return ptr;
+	} else if (!drained) {
+	  // Reclaim what other threads freed before growing.
+	  drained = true;
+	  drainRemoteFrees();
 	} else {
 	  Check<HoardManager, sanityCheck> check2 (this);
 	  // Return null if we can't allocate another superblock.
@@ -369,7 +502,7 @@ namespace Hoard {
 	if (!ptr) {
 	  return 0;
 	}
-	sb = new (ptr) SuperblockType (sz);
+	sb = makeSuperblock (ptr, sz);
       }
 
       // Put the superblock into its appropriate bin.
@@ -379,6 +512,15 @@ namespace Hoard {
       return sb;
     }
 
+    /// Format a superblock for objects of size sz, on this thread's memory node.
+    static SuperblockType * makeSuperblock (void * ptr, size_t sz) {
+      const auto node = NUMATopology::getCurrentNode();
+      NUMATopology::bind (ptr, SuperblockSize, node);
+      auto * sb = new (ptr) SuperblockType (sz);
+      sb->setNode (node);
+      return sb;
+    }
+
     LockType _theLock;
 
     /// Usage statistics for each bin.
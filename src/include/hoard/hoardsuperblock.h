@@ -86,6 +86,12 @@ namespace Hoard {
       return ptr;
     }
 
+    /// Allocate up to n objects, returning how many were stored in ptrs.
+    INLINE unsigned int mallocBatch (size_t, void ** ptrs, unsigned int n) {
+      assert (_header.isValid());
+      return _header.mallocBatch (ptrs, n);
+    }
+
     INLINE void free (void * ptr) {
       if (_header.isValid() && inRange (ptr)) {
 	// Pointer is in range.
@@ -141,6 +147,72 @@ namespace Hoard {
       _header.setOwner (o);
     }
     
+    /// Push a chain of objects freed by a non-owner (see the header).
+    inline bool pushRemoteFrees (void * first, void * last) {
+      assert (_header.isValid());
+      return _header.pushRemoteFrees (first, last);
+    }
+
+    inline void * takeRemoteFrees() {
+      assert (_header.isValid());
+      return _header.takeRemoteFrees();
+    }
+
+    inline void * takePendingRemoteFrees() {
+      assert (_header.isValid());
+      return _header.takePendingRemoteFrees();
+    }
+
+    inline HoardSuperblock * getNextPending() const {
+      assert (_header.isValid());
+      return _header.getNextPending();
+    }
+
+    inline void setNextPending (HoardSuperblock * s) {
+      assert (_header.isValid());
+      _header.setNextPending (s);
+    }
+
+    inline bool claimPending() {
+      assert (_header.isValid());
+      return _header.claimPending();
+    }
+
+    inline void clearPending() {
+      assert (_header.isValid());
+      _header.clearPending();
+    }
+
+    inline bool isPending() const {
+      assert (_header.isValid());
+      return _header.isPending();
+    }
+
+    inline bool isQuiescent() const {
+      assert (_header.isValid());
+      return _header.isQuiescent();
+    }
+
+    inline unsigned long getEmptySince() const {
+      assert (_header.isValid());
+      return _header.getEmptySince();
+    }
+
+    inline void setEmptySince (unsigned long t) {
+      assert (_header.isValid());
+      _header.setEmptySince (t);
+    }
+
+    inline int getNode() const {
+      assert (_header.isValid());
+      return _header.getNode();
+    }
+
+    inline void setNode (int n) {
+      assert (_header.isValid());
+      _header.setNode (n);
+    }
+
     inline HoardSuperblock * getNext() const {
       assert (_header.isValid());
       return _header.getNext();
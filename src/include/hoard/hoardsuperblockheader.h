@@ -38,6 +38,7 @@
 
 #include "heaplayers.h"
 
+#include <atomic>
 #include <cstdlib>
 
 #if defined(__clang__)
@@ -84,7 +85,11 @@ namespace Hoard {
 	_reapableObjects (_totalObjects),
 	_objectsFree (_totalObjects),
 	_start (start),
-	_position (start)
+	_position (start),
+	_remoteFrees (0),
+	_nextPending (nullptr),
+	_emptySince (0),
+	_node (0)
     {
       assert ((HL::align<Alignment>((size_t) start) == (size_t) start));
       assert (_objectSize >= Alignment);
@@ -110,6 +115,31 @@ namespace Hoard {
       return ptr;
     }
 
+    /// @brief Allocate up to n objects at once, reaping first.
+    /// @return The number of objects stored in ptrs.
+    inline unsigned int mallocBatch (void ** ptrs, unsigned int n) {
+      assert (isValid());
+      unsigned int count = 0;
+      // Carve a contiguous span out of the reap region...
+      auto reap = (n < _reapableObjects) ? n : _reapableObjects;
+      for (; count < reap; count++) {
+	ptrs[count] = _position;
+	_position += _objectSize;
+      }
+      _reapableObjects -= reap;
+      // ...and take the rest from the freelist.
+      while (count < n) {
+	auto * ptr = _freeList.get();
+	if (!ptr) {
+	  break;
+	}
+	ptrs[count++] = ptr;
+      }
+      assert (_objectsFree >= count);
+      _objectsFree -= count;
+      return count;
+    }
+
     inline void free (void * ptr) {
       assert ((size_t) ptr % Alignment == 0);
       assert (isValid());
@@ -202,6 +232,93 @@ namespace Hoard {
       _prev = p;
     }
 
+    /// @brief Push a chain of objects (linked through their first
+    ///        words) freed by a thread that doesn't own us. Lock-free.
+    /// @return true iff this push marked us pending, in which case the
+    ///         caller must put us on our owner's list of superblocks
+    ///         with remote frees (see notePendingSuperblock).
+    /// @note  Queuing frees and marking us pending are one atomic step,
+    ///        so no one can see the frees without the mark.
+    inline bool pushRemoteFrees (void * first, void * last) {
+      auto state = _remoteFrees.load (std::memory_order_relaxed);
+      do {
+	*reinterpret_cast<void **>(last) = chainOf (state);
+      } while (!_remoteFrees.compare_exchange_weak (state, (size_t) first | Pending,
+						    std::memory_order_release,
+						    std::memory_order_relaxed));
+      return !(state & Pending);
+    }
+
+    /// Take every waiting remote free, as a null-terminated chain
+    /// (leaving our pending mark as it is).
+    inline void * takeRemoteFrees() {
+      auto state = _remoteFrees.load (std::memory_order_relaxed);
+      while (!_remoteFrees.compare_exchange_weak (state, state & Pending,
+						  std::memory_order_acquire,
+						  std::memory_order_relaxed))
+	;
+      return chainOf (state);
+    }
+
+    /// @brief Take every waiting remote free, and clear our pending
+    ///        mark (we're off the list, and our next pointer has been read).
+    inline void * takePendingRemoteFrees() {
+      return chainOf (_remoteFrees.exchange (0, std::memory_order_acq_rel));
+    }
+
+    BlockType * getNextPending() const {
+      return _nextPending;
+    }
+
+    void setNextPending (BlockType * n) {
+      _nextPending = n;
+    }
+
+    /// @brief Mark us pending if remote frees are waiting and we aren't already.
+    /// @return true iff we did (so the caller must list us, as after a push).
+    inline bool claimPending() {
+      auto state = _remoteFrees.load (std::memory_order_relaxed);
+      do {
+	if ((state & Pending) || (chainOf (state) == nullptr)) {
+	  return false;
+	}
+      } while (!_remoteFrees.compare_exchange_weak (state, state | Pending,
+						    std::memory_order_acq_rel,
+						    std::memory_order_relaxed));
+      return true;
+    }
+
+    /// @brief We're off the list (and our next pointer has been read),
+    ///        but leave any remote frees for whoever takes us next.
+    inline void clearPending() {
+      _remoteFrees.fetch_and (~(size_t) Pending, std::memory_order_seq_cst);
+    }
+
+    inline bool isPending() const {
+      return (_remoteFrees.load (std::memory_order_acquire) & Pending);
+    }
+
+    /// No remote frees waiting, and not on (or headed for) any list.
+    inline bool isQuiescent() const {
+      return (_remoteFrees.load (std::memory_order_acquire) == 0);
+    }
+
+    unsigned long getEmptySince() const {
+      return _emptySince;
+    }
+
+    void setEmptySince (unsigned long t) {
+      _emptySince = t;
+    }
+
+    int getNode() const {
+      return _node;
+    }
+
+    void setNode (int n) {
+      _node = n;
+    }
+
     void lock() {
       _theLock.lock();
     }
@@ -212,6 +329,15 @@ namespace Hoard {
 
   private:
 
+    /// The low bit of _remoteFrees: are we on (or headed for) a list
+    /// of superblocks with remote frees? (Objects are aligned, so the
+    /// chain's head never uses it.)
+    enum { Pending = 1 };
+
+    static inline void * chainOf (size_t state) {
+      return reinterpret_cast<void *>(state & ~(size_t) Pending);
+    }
+
     MALLOC_FUNCTION INLINE void * reapAlloc() {
       assert (isValid());
       assert (_position);
@@ -279,6 +405,19 @@ namespace Hoard {
 
     /// The list of freed objects.
     FreeSLList _freeList;
+
+    /// Objects freed by other threads, waiting for our owner to drain
+    /// them, plus our pending mark (we can be on at most one list).
+    std::atomic<size_t> _remoteFrees;
+
+    /// The next superblock in our owner's list of those with remote frees.
+    BlockType * _nextPending;
+
+    /// When a purge pass first found us empty (0 = not yet).
+    unsigned long _emptySince;
+
+    /// The memory node our pages live on.
+    int _node;
   };
 
   // A helper class that pads the header to the desired alignment.
@@ -38,7 +38,9 @@
 
 #include "hoardheap.h"
 #include "heapmanager.h"
+#include "largeobjectcache.h"
 #include "tlab.h"
+#include "percpuheap.h"
 #include "hoardconstants.h"
 
 #include "heaplayers.h"
@@ -65,7 +67,27 @@ namespace Hoard {
   //
   
   class HoardHeapType :
-    public HeapManager<TheLockType, HoardHeap<MaxThreads, NumHeaps> > {
+    public HeapManager<HoardHeap<MaxThreads, NumHeaps> > {
+  public:
+
+    // Purge passes fall due while a per-thread heap is locked; we run
+    // them here, once it's unlocked.
+
+    inline void * malloc (size_t sz) {
+      auto * ptr = Parent::malloc (sz);
+      TheGlobalHeap::purgeIfRequested();
+      return ptr;
+    }
+
+    inline unsigned int mallocBatch (size_t sz, void ** ptrs, unsigned int n) {
+      auto count = Parent::mallocBatch (sz, ptrs, n);
+      TheGlobalHeap::purgeIfRequested();
+      return count;
+    }
+
+  private:
+
+    typedef HeapManager<HoardHeap<MaxThreads, NumHeaps> > Parent;
   };
   
   // Just an abbreviation.
@@ -77,18 +99,36 @@ namespace Hoard {
   // right.
   //
 
-  typedef ThreadLocalAllocationBuffer<HL::bins<TheHeader, SUPERBLOCK_SIZE>::NUM_BINS,
-				      HL::bins<TheHeader, SUPERBLOCK_SIZE>::getSizeClass,
-				      HL::bins<TheHeader, SUPERBLOCK_SIZE>::getClassSize,
+  //
+  // Each TLAB's cache of freed large objects, binned like the big heap's.
+  //
+
+  typedef LargeObjectCache<NumBigObjectClasses,
+			   GeometricSizeClass<20>::size2class,
+			   GeometricSizeClass<20>::class2size,
+			   LargestCachedLargeObject,
+			   MaxBytesPerLargeObjectCache>
+  TheLargeObjectCache;
+
+  typedef ThreadLocalAllocationBuffer<HoardSizeClasses<SUPERBLOCK_SIZE>::NUM_BINS,
+				      HoardSizeClasses<SUPERBLOCK_SIZE>::getSizeClass,
+				      HoardSizeClasses<SUPERBLOCK_SIZE>::getClassSize,
+				      BigObjectSize,
 				      LargestSmallObject,
 				      MAX_MEMORY_PER_TLAB,
 				      HoardHeapType::SuperblockType,
 				      SUPERBLOCK_SIZE,
+				      TheLargeObjectCache,
 				      HoardHeapType>
   TLABBase;
   
 }
 
+#if HOARD_PER_CPU_CACHE
+// One TLAB per CPU, shared by the threads running there.
+typedef HL::ANSIWrapper<Hoard::PerCPUHeap<Hoard::MaxCPUs, TheLockType, Hoard::TLABBase> > TheCustomHeapType;
+#else
 typedef HL::ANSIWrapper<Hoard::TLABBase> TheCustomHeapType;
+#endif
 
 #endif
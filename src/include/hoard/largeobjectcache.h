@@ -0,0 +1,151 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+#ifndef HOARD_LARGEOBJECTCACHE_H
+#define HOARD_LARGEOBJECTCACHE_H
+
+#include <cassert>
+#include <cstddef>
+
+#include "heaplayers.h"
+#include "array.h"
+
+namespace Hoard {
+
+  /**
+   * @class LargeObjectCache
+   * @brief A thread's stash of recently freed large objects, binned by
+   *        size class, so it can reuse them without a trip (and a lock)
+   *        to the shared large-object heap.
+   * @note  Not thread-safe: it belongs to one thread (or is guarded by
+   *        its owner's lock). Holds at most MaxBytes bytes.
+   */
+
+  template <int NumBins,
+	    int (*getSizeClass) (size_t),
+	    size_t (*getClassSize) (int),
+	    size_t MaxObjectSize,
+	    size_t MaxBytes>
+  class LargeObjectCache {
+  public:
+
+    LargeObjectCache()
+      : _bytes (0)
+    {
+      for (auto i = 0; i < NumBins; i++) {
+	_bins(i) = nullptr;
+      }
+    }
+
+    /// @return a cached object of at least sz bytes, or null if none.
+    inline void * malloc (size_t sz) {
+      if ((_bytes == 0) || (sz > MaxObjectSize)) {
+	return nullptr;
+      }
+      auto c = getSizeClass (sz);
+      assert (c < NumBins);
+      auto * e = _bins(c);
+      if (!e) {
+	return nullptr;
+      }
+      // Everything in bin c is at least as big as class c, so it fits.
+      assert (e->size >= sz);
+      _bins(c) = e->next;
+      _bytes -= e->size;
+      return e;
+    }
+
+    /// @brief Cache an object of sz bytes, making room by handing older
+    ///        ones to parent if need be.
+    /// @return true iff the object is now in the cache.
+    template <class ParentHeap>
+    inline bool free (void * ptr, size_t sz, ParentHeap * parent) {
+      if ((sz > MaxObjectSize) || (sz > MaxBytes)) {
+	return false;
+      }
+      // Bin by the largest class that sz covers in full.
+      auto c = getSizeClass (sz);
+      if (getClassSize (c) > sz) {
+	if (c == 0) {
+	  return false;
+	}
+	c--;
+      }
+      assert (c < NumBins);
+      while (_bytes + sz > MaxBytes) {
+	evict (parent);
+      }
+      auto * e = reinterpret_cast<Entry *>(ptr);
+      e->next = _bins(c);
+      e->size = sz;
+      _bins(c) = e;
+      _bytes += sz;
+      return true;
+    }
+
+    /// Hand every cached object to parent.
+    template <class ParentHeap>
+    void clear (ParentHeap * parent) {
+      while (_bytes > 0) {
+	evict (parent);
+      }
+    }
+
+  private:
+
+    class Entry {
+    public:
+      Entry * next;
+      size_t size;
+    };
+
+    /// Give back an object from the largest non-empty bin.
+    template <class ParentHeap>
+    NO_INLINE void evict (ParentHeap * parent) {
+      for (auto c = NumBins - 1; c >= 0; c--) {
+	auto * e = _bins(c);
+	if (e) {
+	  _bins(c) = e->next;
+	  _bytes -= e->size;
+	  parent->free (e);
+	  return;
+	}
+      }
+      assert (_bytes == 0);
+    }
+
+    /// The number of bytes cached.
+    size_t _bytes;
+
+    /// The cached objects, by size class.
+    Array<NumBins, Entry *> _bins;
+
+  };
+
+}
+
+#endif
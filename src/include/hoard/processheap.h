@@ -29,47 +29,209 @@
 #define HOARD_PROCESSHEAP_H
 
 #include <cstdlib>
+#include <new>
 
-#include "alignedsuperblockheap.h"
-#include "conformantheap.h"
-#include "emptyhoardmanager.h"
-#include "hoardmanager.h"
+#include "array.h"
+#include "basehoardmanager.h"
+#include "hoardconstants.h"
 #include "hoardsuperblock.h"
+#include "purgepolicy.h"
+#include "sizeclasses.h"
+#include "superblockstack.h"
+#include "systempagesize.h"
 
 namespace Hoard {
 
+  /**
+   * @class ProcessHeap
+   * @brief Holds the superblocks that per-thread heaps give up, for
+   *        any thread to take, without locking.
+   * @note  Superblocks are kept on lock-free stacks, by size class and
+   *        by how full they were when they arrived. Objects freed into
+   *        them meanwhile are queued as remote frees, and drained by
+   *        whoever takes them next, so we never take superblock locks
+   *        (except to wait out a freer before purging).
+   */
+
   template <size_t SuperblockSize,
 	    template <class LockType_,
 		      int SuperblockSize_,
 		      typename HeapType_> class Header_,
-	    int EmptinessClasses,
-	    class LockType,
-	    class ThresholdClass,
-	    class MmapSource>
+	    class LockType>
   class ProcessHeap :
-    public ConformantHeap<
-    HoardManager<AlignedSuperblockHeap<LockType, SuperblockSize, MmapSource>,
-		 EmptyHoardManager<HoardSuperblock<LockType,
-						   SuperblockSize,
-						   ProcessHeap<SuperblockSize, Header_, EmptinessClasses, LockType, ThresholdClass, MmapSource>,
-						   Header_>>,
-		 HoardSuperblock<LockType,
-				 SuperblockSize,
-				 ProcessHeap<SuperblockSize, Header_, EmptinessClasses, LockType, ThresholdClass, MmapSource>, Header_>,
-		 EmptinessClasses,
-		 LockType,
-		 ThresholdClass,
-		 ProcessHeap<SuperblockSize, Header_, EmptinessClasses, LockType, ThresholdClass, MmapSource> > > {
-  
+    public BaseHoardManager<HoardSuperblock<LockType,
+					    SuperblockSize,
+					    ProcessHeap<SuperblockSize, Header_, LockType>,
+					    Header_>> {
   public:
-  
+
+    typedef HoardSuperblock<LockType, SuperblockSize, ProcessHeap, Header_> SuperblockType;
+
+    enum { Alignment = SuperblockType::Header::Alignment };
+
     ProcessHeap (void) {}
-    
+
     // Disable allocation from this heap.
     inline void * malloc (size_t);
 
+    /// Put a superblock on this heap.
+    void put (SuperblockType * s, size_t sz) {
+      assert (s->isValidSuperblock());
+      auto& stack = _available (stackIndex (binType::getSizeClass (sz), getFullness (s)));
+      s->setOwner (this);
+      stack.push (s);
+    }
+
+    /// Get an empty (or nearly-empty) superblock for dest, whose lock the caller holds.
+    SuperblockType * get (size_t sz, ProcessHeap * dest) {
+      drainRemoteFrees();
+      const auto binIndex = binType::getSizeClass (sz);
+      SuperblockType * s = nullptr;
+      for (auto i = 0; (i < GlobalHeapFullnessGroups) && !s; i++) {
+	s = _available (stackIndex (binIndex, i)).pop();
+      }
+      if (!s) {
+	s = _purged.pop();
+	if (!s) {
+	  return nullptr;
+	}
+	// Recycle a purged superblock (of any size) for this one. (No
+	// one can free into it or list it: it was quiescent and empty.)
+	assert (s->isQuiescent());
+	const auto node = s->getNode();
+	s = new (s) SuperblockType (binType::getClassSize (binIndex));
+	s->setNode (node);
+      }
+      assert (s->isValidSuperblock());
+      // From here on, dest's lock protects s. Frees queued before
+      // the handover are ours to drain; later ones go to dest.
+      s->setOwner (dest);
+      s->setEmptySince (0);
+      std::atomic_thread_fence (std::memory_order_seq_cst);
+      drainSuperblock (s);
+      return s;
+    }
+
+    /// Free an object in one of our superblocks, by queuing it there.
+    inline void free (void * ptr) {
+      auto * s = BaseHoardManager<SuperblockType>::getSuperblock (ptr);
+      assert (s->getOwner() == this);
+      if (s->pushRemoteFrees (ptr, ptr)) {
+	BaseHoardManager<SuperblockType>::notePendingSuperblock (s);
+      }
+    }
+
+    /// @brief Pass superblocks with remote frees along to their owners.
+    /// @note  We drain our own as they leave (or get purged), so we
+    ///        just unmark those.
+    void drainRemoteFrees (void) {
+      auto * s = BaseHoardManager<SuperblockType>::takePendingSuperblocks();
+      while (s) {
+	auto * next = s->getNextPending();
+	auto * owner = reinterpret_cast<BaseHoardManager<SuperblockType> *>(s->getOwner());
+	if (owner == this) {
+	  s->clearPending();
+	  // If get() just handed s on, frees queued while we held the
+	  // mark were not listed anywhere: list them with the new owner.
+	  // (Only a superblock with frees waiting can be claimed, and
+	  // those are never purged.)
+	  std::atomic_thread_fence (std::memory_order_seq_cst);
+	  owner = reinterpret_cast<BaseHoardManager<SuperblockType> *>(s->getOwner());
+	  if ((owner == this) || !s->claimPending()) {
+	    s = next;
+	    continue;
+	  }
+	}
+	owner->notePendingSuperblock (s);
+	s = next;
+      }
+    }
+
+    /// @brief Give the memory of superblocks that have been empty for
+    ///        at least age ms (as of now) back to the OS.
+    /// @note  We keep their address space (and headers), to recycle in get().
+    /// @note  Callers must not hold any heap or superblock locks.
+    NO_INLINE void purge (unsigned long now, unsigned long age) {
+      drainRemoteFrees();
+      for (auto i = 0; i < NumBins * GlobalHeapFullnessGroups; i++) {
+	auto * s = _available(i).popAll();
+	while (s) {
+	  auto * next = s->getNext();
+	  // Objects still queued by remote frees would keep s from
+	  // looking empty.
+	  drainSuperblock (s);
+	  const auto fullness = getFullness (s);
+	  if (fullness > 0) {
+	    s->setEmptySince (0);
+	  } else if (s->getEmptySince() == 0) {
+	    s->setEmptySince (now);
+	  }
+	  // If s is on (or headed for) some heap's list of superblocks
+	  // with remote frees, we must leave its header alone until that
+	  // heap passes it back to us. Once it's quiescent and empty, no
+	  // one can queue frees on it (or list it) again.
+	  if ((fullness == 0) && (now - s->getEmptySince() >= age) && s->isQuiescent()) {
+	    // Whoever freed the last object may still hold the lock; since
+	    // all that's left for them is to let go, this can't deadlock.
+	    s->lock();
+	    s->unlock();
+	    // Keep the first page, which holds the header. (With pages
+	    // as big as a superblock, that's all of it.)
+	    const auto pageSize = SystemPageSize::get();
+	    if (pageSize < SuperblockSize) {
+	      PurgePolicy::release ((char *) s + pageSize, SuperblockSize - pageSize);
+	    }
+	    _purged.push (s);
+	  } else {
+	    _available (stackIndex (i / GlobalHeapFullnessGroups, fullness)).push (s);
+	  }
+	  s = next;
+	}
+      }
+    }
+
   private:
 
+    /// The type of the bin manager.
+    typedef HoardSizeClasses<SuperblockSize> binType;
+
+    /// How many bins do we need to maintain?
+    enum { NumBins = binType::NUM_BINS };
+
+    static_assert(SuperblockSize % PageSize == 0,
+		  "Superblocks must be made of whole pages.");
+
+    static inline int stackIndex (int binIndex, int fullness) {
+      return binIndex * GlobalHeapFullnessGroups + fullness;
+    }
+
+    /// 0 = completely empty, up to GlobalHeapFullnessGroups - 1 (mostly or completely full).
+    static inline int getFullness (SuperblockType * s) {
+      auto total = s->getTotalObjects();
+      auto inUse = total - s->getObjectsFree();
+      if (inUse == 0) {
+	return 0;
+      }
+      auto f = 1 + (int) (((GlobalHeapFullnessGroups - 1) * inUse) / total);
+      return (f < GlobalHeapFullnessGroups) ? f : GlobalHeapFullnessGroups - 1;
+    }
+
+    /// Free every object queued on s by remote frees (s must be ours alone).
+    static void drainSuperblock (SuperblockType * s) {
+      auto * ptr = s->takeRemoteFrees();
+      while (ptr) {
+	auto * next = *reinterpret_cast<void **>(ptr);
+	s->free (ptr);
+	ptr = next;
+      }
+    }
+
+    /// Superblocks for each size class, by fullness.
+    Array<NumBins * GlobalHeapFullnessGroups, SuperblockStack<SuperblockType>> _available;
+
+    /// Purged superblocks, ready for reuse at any size.
+    SuperblockStack<SuperblockType> _purged;
+
     // Prevent copying or assignment.
     ProcessHeap (const ProcessHeap&);
     ProcessHeap& operator=(const ProcessHeap&);
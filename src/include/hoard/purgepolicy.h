@@ -0,0 +1,139 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.emeryberger.com
+ 
+  Copyright (c) 1998-2018 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+#ifndef HOARD_PURGEPOLICY_H
+#define HOARD_PURGEPOLICY_H
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+#include "heaplayers.h"
+#include "hoardconstants.h"
+
+namespace Hoard {
+
+  /**
+   * @class PurgePolicy
+   * @brief Says when the global heap gives empty superblocks back to the OS.
+   *
+   * A superblock is purged once it has sat empty in the global heap
+   * for the purge delay, in milliseconds: HOARD_PURGE_DELAY_MS, or
+   * DefaultPurgeDelayMs if unset. A negative delay turns purging off.
+   * Passes run opportunistically, after heaps get superblocks from the
+   * global heap (once they've released their locks), at most every
+   * delay / PurgePassesPerDelay ms.
+   */
+
+  class PurgePolicy {
+  public:
+
+    /// @return a (never zero) timestamp, in milliseconds.
+    static inline unsigned long now() {
+      auto t = std::chrono::steady_clock::now().time_since_epoch();
+      return (unsigned long) std::chrono::duration_cast<std::chrono::milliseconds>(t).count() + 1;
+    }
+
+    /// @return the purge delay in milliseconds, or a negative number if off.
+    static long getDelay() {
+      auto d = delay().load (std::memory_order_relaxed);
+      if (d == Unset) {
+	// First time through: read the environment (without allocating).
+	d = DefaultPurgeDelayMs;
+	auto * env = getenv ("HOARD_PURGE_DELAY_MS");
+	if (env) {
+	  d = strtol (env, nullptr, 10);
+	}
+	setDelay (d);
+      }
+      return d;
+    }
+
+    static void setDelay (long ms) {
+      delay().store ((ms < 0) ? -1 : ms, std::memory_order_relaxed);
+    }
+
+    /// @return how long to wait between purge passes, in milliseconds.
+    static unsigned long getInterval() {
+      auto d = getDelay();
+      if (d < 0) {
+	// Purging is off; check back every so often.
+	d = DefaultPurgeDelayMs;
+      }
+      if (d < (long) PurgePassesPerDelay) {
+	return 1;
+      }
+      return (unsigned long) d / PurgePassesPerDelay;
+    }
+
+    /// @return true iff the caller should run a purge pass now.
+    /// @note   At most one caller per interval gets true.
+    static bool isDue (unsigned long t) {
+      if (getDelay() < 0) {
+	return false;
+      }
+      auto last = lastPass().load (std::memory_order_relaxed);
+      if (t - last < getInterval()) {
+	return false;
+      }
+      return lastPass().compare_exchange_strong (last, t, std::memory_order_relaxed);
+    }
+
+    /// Give the physical memory behind [ptr, ptr+sz) back to the OS.
+    static void release (void * ptr, size_t sz) {
+#if HOARD_PURGE_LAZILY && defined(MADV_FREE)
+      // Let the kernel take the pages only when it needs them.
+      madvise (ptr, sz, MADV_FREE);
+#else
+      HL::MmapWrapper::release (ptr, sz);
+#endif
+    }
+
+  private:
+
+    enum { Unset = LONG_MIN };
+
+    static inline std::atomic<long>& delay() {
+      static std::atomic<long> d (Unset);
+      return d;
+    }
+
+    static inline std::atomic<unsigned long>& lastPass() {
+      static std::atomic<unsigned long> t (0);
+      return t;
+    }
+
+  };
+
+}
+
+#endif
@@ -28,14 +28,19 @@
 #ifndef HOARD_REDIRECTFREE_H
 #define HOARD_REDIRECTFREE_H
 
+#include <algorithm>
+
 #include "heaplayers.h"
+#include "hoardconstants.h"
 
 namespace Hoard {
 
   /**
    * @class RedirectFree
    * @brief Routes free calls to the Superblock's owner heap.
-   * @note  We also lock the heap on calls to malloc.
+   * @note  We also lock the heap on calls to malloc. Objects from
+   *        superblocks that some other heap owns are queued on the
+   *        superblock without locking, for that heap to drain later.
    */
 
   template <class Heap,
@@ -58,6 +63,16 @@ namespace Hoard {
       return ptr;
     }
 
+    /// Allocate up to n objects under a single lock acquisition.
+    inline unsigned int mallocBatch (size_t sz, void ** ptrs, unsigned int n) {
+      return _theHeap.mallocBatch (sz, ptrs, n);
+    }
+
+    /// Return surplus memory to the parent heap.
+    inline void scavenge() {
+      _theHeap.scavenge();
+    }
+
     size_t getSize (void * ptr) {
       return Heap::getSize (ptr);
     }
@@ -66,38 +81,134 @@ namespace Hoard {
       return Heap::getSuperblock (ptr);
     }
 
+    /// How many times threads have had to wait for this heap.
+    inline unsigned int getContention() const {
+      return _theHeap.getContention();
+    }
+
+    /// Is this the heap that owns the given superblock?
+    inline bool owns (SuperblockType * s) {
+      return reinterpret_cast<baseHeapType>(s->getOwner()) == ownHeap();
+    }
+
     /// Free the given object, obeying the required locking protocol.
-    static inline void free (void * ptr) {
+    inline void free (void * ptr) {
       // Get the superblock header.
-      SuperblockType * s = reinterpret_cast<SuperblockType *>(Heap::getSuperblock (ptr));
+      SuperblockType * s = getSuperblockOf (ptr);
 
       assert (s->isValidSuperblock());
 
-      // Find out who the owner is.
-
-      typedef BaseHoardManager<SuperblockType> * baseHeapType;
-      baseHeapType owner;
+      if (reinterpret_cast<baseHeapType>(s->getOwner()) != ownHeap()) {
+	// Not ours: hand it back without taking any locks.
+	remoteFree (s, ptr, ptr);
+	return;
+      }
 
       s->lock();
+      auto owner = lockOwner (s);
+      owner->free (ptr);
+      owner->unlock();
+      s->unlock();
+    }
 
-      // By acquiring the lock on the superblock (above),
+    /// @brief Free a batch of objects, locking each owner heap once.
+    /// @note  Reorders (and clobbers) the contents of ptrs.
+    void freeBatch (void ** ptrs, unsigned int n) {
+      // Sorting by address clusters objects from the same superblock.
+      std::sort (ptrs, ptrs + n);
+      // Queue each run from someone else's superblock in one push.
+      unsigned int i = 0;
+      while (i < n) {
+	SuperblockType * s = getSuperblockOf (ptrs[i]);
+	assert (s->isValidSuperblock());
+	auto j = i + 1;
+	while ((j < n) && (getSuperblockOf (ptrs[j]) == s)) {
+	  j++;
+	}
+	if (reinterpret_cast<baseHeapType>(s->getOwner()) != ownHeap()) {
+	  for (auto k = i; k < j - 1; k++) {
+	    *reinterpret_cast<void **>(ptrs[k]) = ptrs[k + 1];
+	  }
+	  remoteFree (s, ptrs[i], ptrs[j - 1]);
+	  for (auto k = i; k < j; k++) {
+	    ptrs[k] = nullptr;
+	  }
+	}
+	i = j;
+      }
+      // Free the rest (ours) under the lock.
+      for (i = 0; i < n; i++) {
+	if (!ptrs[i]) {
+	  // Already freed along with an earlier group.
+	  continue;
+	}
+	SuperblockType * s = getSuperblockOf (ptrs[i]);
+	assert (s->isValidSuperblock());
+	s->lock();
+	auto owner = lockOwner (s);
+	// Superblocks only change hands under their owner's lock, so
+	// while we hold it, we can free everything else it owns too.
+	for (auto j = i; j < n; j++) {
+	  if (ptrs[j] &&
+	      (reinterpret_cast<baseHeapType>(getSuperblockOf (ptrs[j])->getOwner()) == owner)) {
+	    owner->free (ptrs[j]);
+	    ptrs[j] = nullptr;
+	  }
+	}
+	owner->unlock();
+	s->unlock();
+      }
+    }
+
+  private:
+
+    typedef BaseHoardManager<SuperblockType> * baseHeapType;
+
+    /// The heap whose superblocks we free into directly.
+    inline baseHeapType ownHeap() {
+      return &_theHeap;
+    }
+
+    /// Queue a chain of objects on a superblock owned by another heap.
+    static void remoteFree (SuperblockType * s, void * first, void * last) {
+      if (!s->pushRemoteFrees (first, last)) {
+	// Its owner already knows there's something to drain.
+	return;
+      }
+      // We marked s pending, so it stays put until it's on a list.
+      // The owner may change under us, but if it does, the old one
+      // passes the news along.
+      auto owner = reinterpret_cast<baseHeapType>(s->getOwner());
+      if (owner->notePendingSuperblock (s) >= MaxPendingSuperblocks) {
+	// The owner isn't keeping up (or has gone idle): drain on its behalf.
+	owner->lock();
+	owner->drainRemoteFrees();
+	owner->unlock();
+      }
+    }
+
+    static inline SuperblockType * getSuperblockOf (void * ptr) {
+      return reinterpret_cast<SuperblockType *>(Heap::getSuperblock (ptr));
+    }
+
+    /// Find and lock the owner of a superblock whose lock we hold.
+    static inline baseHeapType lockOwner (SuperblockType * s) {
+
+      // By acquiring the lock on the superblock (beforehand),
       // we prevent it from moving up to a higher heap.
       // This eventually pins it down in one heap,
       // so this loop is guaranteed to terminate.
       // (It should generally take no more than two iterations.)
 
       for (;;) {
-	owner = reinterpret_cast<baseHeapType>(s->getOwner());
+	auto owner = reinterpret_cast<baseHeapType>(s->getOwner());
 	assert (owner != nullptr);
 	assert (owner->isValid());
 	// Lock the owner. If ownership changed between these two lines,
 	// we'll detect it and try again.
 	owner->lock();
 	if (owner == reinterpret_cast<baseHeapType>(s->getOwner())) {
-	  owner->free (ptr);
-	  owner->unlock();
-	  s->unlock();
-	  return;
+	  return owner;
 	}
 	owner->unlock();
 
@@ -106,8 +217,6 @@ namespace Hoard {
       }
     }
 
-  private:
-
     Heap _theHeap;
 
   };
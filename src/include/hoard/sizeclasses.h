@@ -0,0 +1,191 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+
+#ifndef HOARD_SIZECLASSES_H
+#define HOARD_SIZECLASSES_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include "heaplayers.h"
+
+// Size class spacing, chosen at build time:
+//   HOARD_SIZE_CLASS_STEP=16 (default): one class every 16 bytes up
+//     to 1K, then four per power of two.
+//   HOARD_SIZE_CLASS_STEP=8: the same, every 8 bytes (only for
+//     platforms whose malloc alignment is 8).
+//   HOARD_SIZE_CLASS_STEP=0: four classes per power of two above 64
+//     bytes (quarter powers of two), trading internal fragmentation
+//     for fewer, fuller size classes.
+
+#ifndef HOARD_SIZE_CLASS_STEP
+#define HOARD_SIZE_CLASS_STEP 16
+#endif
+
+namespace Hoard {
+
+  /// The floor of log2(v), at compile time.
+  constexpr unsigned int log2floor (size_t v) {
+    return (v <= 1) ? 0 : 1 + log2floor (v >> 1);
+  }
+
+  /**
+   * @class SizeClassEngine
+   * @brief Size classes computed at compile time.
+   *
+   * Sizes up to LinearLimit get a class every Step bytes; above that,
+   * each power of two is split into ClassesPerDoubling classes, up to
+   * MaxSize. Lookups for sizes up to TableLimit go through a dense,
+   * constexpr-built table; bigger ones use log2 plus the next few
+   * bits of the size (the "mantissa").
+   *
+   * The interface mirrors HL::bins (NUM_BINS, BIG_OBJECT,
+   * getSizeClass, getClassSize).
+   */
+
+  template <size_t Step,
+	    size_t LinearLimit,
+	    unsigned int ClassesPerDoubling,
+	    size_t MaxSize,
+	    size_t TableLimit = 1024>
+  class SizeClassEngine {
+  public:
+
+    enum { NUM_BINS = (int) (LinearLimit / Step) + (int) ClassesPerDoubling * (int) (log2floor (MaxSize) - log2floor (LinearLimit)) };
+    enum { BIG_OBJECT = MaxSize };
+
+    static_assert((Step & (Step - 1)) == 0, "Step must be a power of two.");
+    static_assert(Step >= HL::MallocInfo::Alignment, "Step must preserve malloc alignment.");
+    static_assert(LinearLimit % Step == 0, "The linear range must be a multiple of the step.");
+    static_assert((ClassesPerDoubling & (ClassesPerDoubling - 1)) == 0,
+		  "Classes per doubling must be a power of two.");
+    static_assert((LinearLimit / ClassesPerDoubling) % Step == 0,
+		  "Geometric classes must stay multiples of the step.");
+    static_assert((LinearLimit & (LinearLimit - 1)) == 0, "The linear range must end at a power of two.");
+    static_assert((MaxSize & (MaxSize - 1)) == 0, "The largest size must be a power of two.");
+    static_assert(LinearLimit <= TableLimit, "The table must cover the linear range.");
+    static_assert(TableLimit <= MaxSize, "The table must not run past the largest size.");
+    static_assert(NUM_BINS <= 256, "Class indices must fit in a byte.");
+
+    /// @return the size class for a given size (which must be at most BIG_OBJECT).
+    static inline int getSizeClass (size_t sz) {
+      assert (sz <= MaxSize);
+      if (sz <= TableLimit) {
+	return _table.classes[(sz + Step - 1) / Step];
+      }
+      return geometricClass (sz, ilog2 (sz - 1));
+    }
+
+    /// @return the largest size for a given size class.
+    static inline size_t getClassSize (int cl) {
+      assert ((cl >= 0) && (cl < NUM_BINS));
+      return computeClassSize (cl);
+    }
+
+  private:
+
+    enum { NumLinear = (int) (LinearLimit / Step) };
+
+    /// The (run-time) floor of log2(v), for v > 0.
+    static inline unsigned int ilog2 (size_t v) {
+#if defined(__GNUC__)
+      return (unsigned int) (sizeof(unsigned long long) * 8 - 1) - (unsigned int) __builtin_clzll ((unsigned long long) v);
+#else
+      return log2floor (v);
+#endif
+    }
+
+    /// The class of a size past the linear range, given lg = log2floor(sz - 1).
+    static constexpr int geometricClass (size_t sz, unsigned int lg) {
+      // Each doubling (B, 2B] is cut into ClassesPerDoubling pieces;
+      // the bits just below the leading one of (sz - 1) say which.
+      return NumLinear
+	+ (int) ((lg - log2floor (LinearLimit)) * ClassesPerDoubling)
+	+ (int) (((sz - 1) >> (lg - log2floor (ClassesPerDoubling))) - ClassesPerDoubling);
+    }
+
+    static constexpr int computeSizeClass (size_t sz) {
+      return (sz <= LinearLimit)
+	? ((sz == 0) ? 0 : (int) ((sz + Step - 1) / Step) - 1)
+	: geometricClass (sz, log2floor (sz - 1));
+    }
+
+    static constexpr size_t computeClassSize (int cl) {
+      return (cl < NumLinear)
+	? (size_t) (cl + 1) * Step
+	: (LinearLimit << ((unsigned int) (cl - NumLinear) / ClassesPerDoubling))
+	+ ((unsigned int) (cl - NumLinear) % ClassesPerDoubling + 1)
+	* ((LinearLimit << ((unsigned int) (cl - NumLinear) / ClassesPerDoubling)) / ClassesPerDoubling);
+    }
+
+    /// The dense lookup table for small sizes, indexed by size / Step (rounded up).
+    class Table {
+    public:
+      constexpr Table()
+	: classes {}
+      {
+	for (size_t i = 0; i <= TableLimit / Step; i++) {
+	  classes[i] = (uint8_t) computeSizeClass (i * Step);
+	}
+      }
+      uint8_t classes[TableLimit / Step + 1];
+    };
+
+    static constexpr Table _table {};
+
+    // Sanity checks, all at compile time.
+    static_assert(computeClassSize (NUM_BINS - 1) == MaxSize, "The last class must be the largest size.");
+    static_assert(computeSizeClass (MaxSize) == NUM_BINS - 1, "The largest size must map to the last class.");
+    static_assert(computeSizeClass (LinearLimit + 1) == NumLinear, "Sizes just past the linear range need the first geometric class.");
+    static_assert(computeClassSize (computeSizeClass (TableLimit + 1)) >= TableLimit + 1, "Classes must hold their sizes.");
+    static_assert(computeClassSize (computeSizeClass (TableLimit + 1) - 1) < TableLimit + 1, "Classes must be tight.");
+
+  };
+
+  template <size_t Step, size_t LinearLimit, unsigned int ClassesPerDoubling, size_t MaxSize, size_t TableLimit>
+  constexpr typename SizeClassEngine<Step, LinearLimit, ClassesPerDoubling, MaxSize, TableLimit>::Table
+  SizeClassEngine<Step, LinearLimit, ClassesPerDoubling, MaxSize, TableLimit>::_table;
+
+  /// @class HoardSizeClasses
+  /// @brief The size classes for objects held in superblocks, as
+  ///        selected by HOARD_SIZE_CLASS_STEP. Every superblock can
+  ///        hold at least a handful of its biggest objects.
+
+  template <size_t SuperblockSize>
+  class HoardSizeClasses :
+#if HOARD_SIZE_CLASS_STEP == 0
+    public SizeClassEngine<16, 64, 4, SuperblockSize / 8>
+#else
+    public SizeClassEngine<HOARD_SIZE_CLASS_STEP, 1024, 4, SuperblockSize / 8>
+#endif
+  {};
+
+}
+
+#endif
@@ -0,0 +1,119 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.emeryberger.com
+
+  Copyright (c) 1998-2018 Emery Berger
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+#ifndef HOARD_SUPERBLOCKSTACK_H
+#define HOARD_SUPERBLOCKSTACK_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace Hoard {
+
+  /**
+   * @class SuperblockStack
+   * @brief A lock-free stack of superblocks, linked through their headers.
+   * @note  Superblocks are aligned to their size, so the low bits of the
+   *        top pointer are free to carry a version, which changes on
+   *        every update. That keeps a pop that read a stale top from
+   *        succeeding (the ABA problem).
+   * @note  Superblock headers must stay mapped and valid, since a
+   *        stale pop may still read one.
+   */
+
+  template <class SuperblockType>
+  class SuperblockStack {
+  public:
+
+    SuperblockStack()
+      : _top (0)
+    {}
+
+    void push (SuperblockType * s) {
+      auto top = _top.load (std::memory_order_relaxed);
+      do {
+	s->setNext (pointer (top));
+      } while (!_top.compare_exchange_weak (top, tagged (s, top),
+					    std::memory_order_release,
+					    std::memory_order_relaxed));
+    }
+
+    SuperblockType * pop() {
+      auto top = _top.load (std::memory_order_acquire);
+      for (;;) {
+	auto * s = pointer (top);
+	if (!s) {
+	  return nullptr;
+	}
+	// If s was popped meanwhile, this may be junk, but then the
+	// version has moved on and the exchange fails.
+	auto * next = s->getNext();
+	if (_top.compare_exchange_weak (top, tagged (next, top),
+					std::memory_order_acquire,
+					std::memory_order_acquire)) {
+	  s->setNext (nullptr);
+	  return s;
+	}
+      }
+    }
+
+    /// Empty the stack, returning its contents chained through their next pointers.
+    SuperblockType * popAll() {
+      auto top = _top.load (std::memory_order_acquire);
+      while (!_top.compare_exchange_weak (top, tagged (nullptr, top),
+					  std::memory_order_acquire,
+					  std::memory_order_acquire))
+	;
+      return pointer (top);
+    }
+
+  private:
+
+    typedef uintptr_t TaggedPointer;
+
+    enum { SuperblockSize = sizeof(SuperblockType) };
+
+    static_assert((SuperblockSize & (SuperblockSize-1)) == 0,
+		  "Superblock size must be a power of two.");
+
+    enum { VersionMask = SuperblockSize - 1 };
+
+    static inline SuperblockType * pointer (TaggedPointer t) {
+      return reinterpret_cast<SuperblockType *>(t & ~(TaggedPointer) VersionMask);
+    }
+
+    /// Point to s, with a version one past that of old.
+    static inline TaggedPointer tagged (SuperblockType * s, TaggedPointer old) {
+      return reinterpret_cast<TaggedPointer>(s) | ((old + 1) & VersionMask);
+    }
+
+    std::atomic<TaggedPointer> _top;
+
+  };
+
+}
+
+#endif
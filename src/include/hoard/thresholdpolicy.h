@@ -0,0 +1,193 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.emeryberger.com
+ 
+  Copyright (c) 1998-2018 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+#ifndef HOARD_THRESHOLDPOLICY_H
+#define HOARD_THRESHOLDPOLICY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+
+namespace Hoard {
+
+  /**
+   * @class ThresholdPolicy
+   * @brief Decides when a heap gives superblocks back to its parent.
+   *
+   * A heap releases a superblock of a size class once that class is
+   * both less than fullness/1000 in use and at least slack superblocks
+   * from being full; it also releases superblocks whenever it holds
+   * more than maxHeapBytes in all. The settings start out as given
+   * by the environment and may be changed at any time:
+   *
+   *   HOARD_RELEASE_FULLNESS   fullness, in thousandths (all classes)
+   *   HOARD_RELEASE_SLACK      slack, in superblocks (all classes)
+   *   HOARD_MAX_HEAP_BYTES     maxHeapBytes (0 = no limit)
+   *   HOARD_SIZE_CLASS_POLICY  size:fullness:slack[,...] for the
+   *                            class of each given object size
+   */
+
+  template <class SizeClasses,
+	    size_t SuperblockSize,
+	    unsigned int DefaultFraction,
+	    unsigned int DefaultSlack>
+  class ThresholdPolicy {
+  public:
+
+    enum { NumBins = SizeClasses::NUM_BINS };
+
+    /// The fullness that stands for "completely full".
+    enum { MaxFullness = 1000 };
+
+    /// The most slack, in superblocks, that we can count in bytes.
+    static constexpr size_t MaxSlack = ~(size_t) 0 / SuperblockSize;
+
+    /// Release when less than (DefaultFraction-1)/DefaultFraction full.
+    enum { DefaultFullness = MaxFullness * (DefaultFraction - 1) / DefaultFraction };
+
+    /// @return the process-wide policy.
+    static ThresholdPolicy& getInstance() {
+      static ThresholdPolicy policy;
+      return policy;
+    }
+
+    /// @brief Should a heap give back a superblock of objects of size objSize?
+    /// @param u         objects of this size in use
+    /// @param a         objects of this size held
+    /// @param heldBytes bytes held by the heap across all sizes
+    inline bool crossed (unsigned int u,
+			 unsigned int a,
+			 size_t objSize,
+			 size_t heldBytes) const
+    {
+      const auto c = SizeClasses::getSizeClass (objSize);
+      const auto fullness = _fullness[c].load (std::memory_order_relaxed);
+      const auto slack = _slack[c].load (std::memory_order_relaxed);
+      // (Heaps holding less than the slack never release on fullness.)
+      const size_t slackObjects = ((size_t) slack * SuperblockSize) / objSize;
+      if (((size_t) MaxFullness * u < (size_t) fullness * a) &&
+	  (a > slackObjects) && (u < a - slackObjects)) {
+	return true;
+      }
+      const auto maxBytes = _maxHeapBytes.load (std::memory_order_relaxed);
+      return (maxBytes > 0) && (heldBytes > maxBytes) && (u < a);
+    }
+
+    /// @brief Set the policy for the size class of objSize (0 = every class).
+    /// @return false if the settings are out of range.
+    bool setThreshold (size_t objSize,
+		       unsigned int fullness,
+		       unsigned int slack)
+    {
+      if ((objSize > SizeClasses::getClassSize (NumBins - 1)) ||
+	  (fullness > MaxFullness) ||
+	  (slack > MaxSlack)) {
+	return false;
+      }
+      if (objSize == 0) {
+	for (int c = 0; c < NumBins; c++) {
+	  set (c, fullness, slack);
+	}
+      } else {
+	set (SizeClasses::getSizeClass (objSize), fullness, slack);
+      }
+      return true;
+    }
+
+    /// Cap the bytes a heap retains (0 = no cap).
+    void setMaxHeapBytes (size_t bytes) {
+      _maxHeapBytes.store (bytes, std::memory_order_relaxed);
+    }
+
+  private:
+
+    ThresholdPolicy()
+      : _maxHeapBytes (0)
+    {
+      for (int c = 0; c < NumBins; c++) {
+	set (c, DefaultFullness, DefaultSlack);
+      }
+      configure();
+    }
+
+    inline void set (int c, unsigned int fullness, unsigned int slack) {
+      _fullness[c].store (fullness, std::memory_order_relaxed);
+      _slack[c].store (slack, std::memory_order_relaxed);
+    }
+
+    /// Read the initial settings from the environment.
+    /// @note We may be in the middle of a malloc: no allocation allowed.
+    void configure() {
+      unsigned int fullness = DefaultFullness;
+      unsigned int slack = DefaultSlack;
+      auto * env = getenv ("HOARD_RELEASE_FULLNESS");
+      if (env) {
+	fullness = (unsigned int) strtoul (env, nullptr, 10);
+      }
+      env = getenv ("HOARD_RELEASE_SLACK");
+      if (env) {
+	slack = (unsigned int) strtoul (env, nullptr, 10);
+      }
+      setThreshold (0, fullness, slack);
+      env = getenv ("HOARD_MAX_HEAP_BYTES");
+      if (env) {
+	setMaxHeapBytes ((size_t) strtoull (env, nullptr, 10));
+      }
+      env = getenv ("HOARD_SIZE_CLASS_POLICY");
+      while (env && *env) {
+	// Each entry is size:fullness:slack, separated by commas.
+	char * end;
+	const auto sz = (size_t) strtoull (env, &end, 10);
+	if (*end != ':') {
+	  break;
+	}
+	fullness = (unsigned int) strtoul (end + 1, &end, 10);
+	if (*end != ':') {
+	  break;
+	}
+	slack = (unsigned int) strtoul (end + 1, &end, 10);
+	if (sz > 0) {
+	  setThreshold (sz, fullness, slack);
+	}
+	env = (*end == ',') ? end + 1 : nullptr;
+      }
+    }
+
+    /// Per size class: release below this fullness, in thousandths...
+    std::atomic<unsigned int> _fullness[NumBins];
+
+    /// ...and with at least this many superblocks' worth free.
+    std::atomic<unsigned int> _slack[NumBins];
+
+    /// Release whenever a heap holds more than this (0 = never).
+    std::atomic<size_t> _maxHeapBytes;
+
+  };
+
+}
+
+#endif
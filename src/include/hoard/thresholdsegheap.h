@@ -3,10 +3,22 @@
 #ifndef HOARD_THRESHOLD_SEGHEAP_H
 #define HOARD_THRESHOLD_SEGHEAP_H
 
+#include <cassert>
+#include <cstddef>
+
+#include "hoardconstants.h"
+#include "purgepolicy.h"
+
 namespace Hoard {
 
   // Allows superheap to hold at least ThresholdSlop but no more than
   // ThresholdFraction% more memory than client currently holds.
+  //
+  // It may also hold on to what the client recently had live (its peak,
+  // which decays over time), so that a client that frees a lot and then
+  // allocates it again doesn't go back to the OS for all of it. Surplus
+  // blocks go back a few at a time, largest first, so no one free pays
+  // for releasing the whole cache.
 
   template <int ThresholdFraction, // % over current allowed in superheap.
 	    int ThresholdSlop,     // constant amount allowed in superheap.
@@ -23,9 +35,13 @@ namespace Hoard {
     ThresholdSegHeap()
       : _currLive (0),
 	_maxLive (0),
-	_maxFraction (1.0 + (double) ThresholdFraction / 100.0),
-	_cleared (false)
-    {}
+	_cached (0),
+	_lastDecay (PurgePolicy::now())
+    {
+      for (int i = 0; i < NumBins; i++) {
+	_count[i] = 0;
+      }
+    }
 
     size_t getSize (void * ptr) {
       return BigHeap::getSize(ptr);
@@ -35,26 +51,30 @@ namespace Hoard {
       if (sz >= MaxObjectSize) {
 	return BigHeap::malloc (sz);
       }
-      // Once the amount of cached memory in the superheap exceeds the
-      // desired threshold over max live requested by the client, dump
-      // it all.
       const int sizeClass = getSizeClass (sz);
       const size_t maxSz = getClassMaxSize (sizeClass);
       if (sizeClass >= NumBins) {
 	return BigHeap::malloc (maxSz);
-      } else {
-	void * ptr = _heap[sizeClass].malloc (maxSz);
+      }
+      void * ptr = _heap[sizeClass].malloc (maxSz);
+      if (ptr == nullptr) {
+	ptr = BigHeap::malloc (maxSz);
 	if (ptr == nullptr) {
-	  return BigHeap::malloc (maxSz);
+	  return nullptr;
 	}
-	assert (getSize(ptr) <= maxSz);
-	_currLive += getSize (ptr);
-	if (_currLive >= _maxLive) {
-	  _maxLive = _currLive;
-	  _cleared = false;
-	}
-	return ptr;
+      } else {
+	assert (_count[sizeClass] > 0);
+	_count[sizeClass]--;
+	_cached -= getSize (ptr);
+      }
+      assert (getSize(ptr) <= maxSz);
+      _currLive += getSize (ptr);
+      if (_currLive >= _maxLive) {
+	_maxLive = _currLive;
       }
+      // Let an old peak go even if nothing gets freed here.
+      releaseSurplus (MaxBigBlocksReleasedPerCall);
+      return ptr;
     }
 
     void free (void * ptr) {
@@ -75,32 +95,120 @@ namespace Hoard {
 	_currLive -= sz;
       }
       _heap[cl].free (ptr);
-      bool crossedThreshold = (double) _maxLive > _maxFraction * (double) _currLive;
-      if ((_currLive > ThresholdSlop) && crossedThreshold && !_cleared)
-	{
-	  // When we drop below the threshold, clear the heap.
-	  for (int i = 0; i < NumBins; i++) {
-	    _heap[i].clear();
-	  }
-	  // We won't clear again until we reach maxlive again.
-	  _cleared = true;
+      _count[cl]++;
+      _cached += sz;
+      releaseSurplus (MaxBigBlocksReleasedPerCall);
+    }
+
+    /// Give back everything cached beyond what the (decayed) peak allows.
+    void scavenge() {
+      releaseSurplus (~0U);
+    }
+
+    /// Give back everything cached, and forget the peak.
+    void clear() {
+      while (_cached > 0) {
+	releaseLargest();
+      }
+      _maxLive = _currLive;
+    }
+
+    /// @brief Resize an object without copying it (see BigHeap::resize).
+    /// @return its (possibly new) address, or null if it must be copied.
+    void * resize (void * ptr, size_t sz) {
+      const size_t oldSz = getSize (ptr);
+      void * q = BigHeap::resize (ptr, sz);
+      if (q == nullptr) {
+	return nullptr;
+      }
+      // Count it as live at its new size, as free() will expect.
+      if (isCounted (oldSz)) {
+	_currLive = (_currLive < oldSz) ? 0 : _currLive - oldSz;
+      }
+      const size_t newSz = getSize (q);
+      if (isCounted (newSz)) {
+	_currLive += newSz;
+	if (_currLive >= _maxLive) {
 	  _maxLive = _currLive;
 	}
+      }
+      return q;
     }
 
   private:
 
+    /// Do we count objects of this size as live (i.e., could we cache them)?
+    static inline bool isCounted (size_t sz) {
+      return (sz < MaxObjectSize) && (getSizeClass (sz) < NumBins);
+    }
+
+    /// How much we may cache now.
+    size_t cacheLimit() const {
+      size_t limit = ThresholdSlop;
+      // What the client recently had live, and so may want again...
+      const size_t recent = _maxLive - _currLive;
+      if (recent > limit) {
+	limit = recent;
+      }
+      // ...or the slack it's always allowed.
+      const size_t slack = _currLive / 100 * ThresholdFraction;
+      if (slack > limit) {
+	limit = slack;
+      }
+      return limit;
+    }
+
+    /// Halve the gap between peak and current live memory every
+    /// BigHeapDecayMs, so an old peak stops keeping memory cached.
+    void decay() {
+      const auto now = PurgePolicy::now();
+      auto halvings = (now - _lastDecay) / BigHeapDecayMs;
+      if (halvings == 0) {
+	return;
+      }
+      _lastDecay += halvings * BigHeapDecayMs;
+      auto gap = _maxLive - _currLive;
+      gap = (halvings < 8 * sizeof(gap)) ? (gap >> halvings) : 0;
+      _maxLive = _currLive + gap;
+    }
+
+    /// Decay the peak, then give back up to n blocks of any surplus.
+    void releaseSurplus (unsigned int n) {
+      decay();
+      for (unsigned int i = 0; (i < n) && (_cached > cacheLimit()); i++) {
+	releaseLargest();
+      }
+    }
+
+    /// Return one block from the largest non-empty size class.
+    void releaseLargest() {
+      for (int i = NumBins - 1; i >= 0; i--) {
+	if (_count[i] > 0) {
+	  void * ptr = _heap[i].malloc (getClassMaxSize (i));
+	  assert (ptr != nullptr);
+	  _count[i]--;
+	  _cached -= getSize (ptr);
+	  BigHeap::free (ptr);
+	  return;
+	}
+      }
+      assert (_cached == 0);
+    }
+
     /// The current amount of live memory held by a client of this heap.
     unsigned long _currLive;
 
-    /// The maximum amount of live memory held by a client of this heap.
+    /// The (decaying) maximum amount of live memory held by a client of this heap.
     unsigned long _maxLive;
 
-    /// Maximum fraction calculation.
-    const double _maxFraction;
+    /// The amount of memory in the superheap.
+    unsigned long _cached;
 
-    /// Have we already cleared out the superheap?
-    bool _cleared;
+    /// When we last decayed _maxLive.
+    unsigned long _lastDecay;
+
+    /// How many blocks each size class holds.
+    unsigned int _count[NumBins];
 
     LittleHeap _heap[NumBins];
   };
@@ -108,4 +216,3 @@ namespace Hoard {
 }
 
 #endif
-
@@ -0,0 +1,68 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+#ifndef HOARD_TRIMEPOCH_H
+#define HOARD_TRIMEPOCH_H
+
+#include <atomic>
+
+namespace Hoard {
+
+  /**
+   * @class TrimEpoch
+   * @brief A process-wide counter that advances on every trim request.
+   *
+   * Thread-local heaps can't be emptied by other threads, so each one
+   * remembers the epoch it last saw and trims itself (lazily) once
+   * the epoch has moved on.
+   */
+
+  class TrimEpoch {
+  public:
+
+    /// @return the current epoch.
+    static inline unsigned long current() {
+      return counter().load (std::memory_order_relaxed);
+    }
+
+    /// Request a trim, returning the new epoch.
+    static inline unsigned long advance() {
+      return counter().fetch_add (1, std::memory_order_relaxed) + 1;
+    }
+
+  private:
+
+    static inline std::atomic<unsigned long>& counter() {
+      static std::atomic<unsigned long> epoch (0);
+      return epoch;
+    }
+
+  };
+
+}
+
+#endif
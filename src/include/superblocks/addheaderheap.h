@@ -87,6 +87,21 @@ namespace Hoard {
       p = reinterpret_cast<typename SuperblockType::Header *>(ptr);
       theHeap.free (reinterpret_cast<void *>(p - 1));
     }
+
+    /// @brief Resize an object (header and all) without copying it.
+    /// @return its (possibly new) address, or null if we can't.
+    void * resize (void * ptr, size_t sz) {
+      const size_t headerSize = sizeof(typename SuperblockType::Header);
+      typename SuperblockType::Header * p;
+      p = reinterpret_cast<typename SuperblockType::Header *>(ptr);
+      void * q = theHeap.resize (reinterpret_cast<void *>(p - 1), sz + headerSize);
+      if (q == nullptr) {
+	return nullptr;
+      }
+      // The header has the old size (and may have moved): rebuild it.
+      p = new (q) typename SuperblockType::Header (sz, sz);
+      return reinterpret_cast<void *>(p + 1);
+    }
   };
 
 }
@@ -32,6 +32,9 @@
 
 #include "conformantheap.h"
 #include "fixedrequestheap.h"
+#include "hoardconstants.h"
+#include "hugepageregion.h"
+#include "reservedarena.h"
 
 namespace Hoard {
 
@@ -57,12 +60,32 @@ namespace Hoard {
     void * malloc (size_t) {
       if (_freeSuperblocks.isEmpty()) {
 	// Get more memory.
-	void * ptr = _superblockSource.malloc (ChunksToGrab * SuperblockSize);
+	int chunks = ChunksToGrab;
+#if HOARD_HUGE_PAGES
+	// Carve a huge-page region into superblocks, so neighboring
+	// superblocks share TLB entries.
+	void * ptr = HugePageRegion<HugePageSize>::map();
+	if (!ptr) {
+	  // Fall back to ordinary pages.
+	  chunks = 1;
+	  ptr = _superblockSource.malloc (SuperblockSize);
+	}
+#else
+	// Carve superblocks from one reservation; this only makes a
+	// system call once per SuperblockCommitSize bytes.
+	void * ptr = TheArena::getInstance().malloc (ChunksToGrab * SuperblockSize);
+	if (!ptr) {
+	  // No address space to reserve: map them one at a time.
+	  ptr = _superblockSource.malloc (ChunksToGrab * SuperblockSize);
+	}
+#endif
 	if (!ptr) {
 	  return nullptr;
 	}
 	char * p = (char *) ptr;
-	for (int i = 0; i < ChunksToGrab; i++) {
+	for (int i = 0; i < chunks; i++) {
+	  // Tell the page map these hold superblocks.
+	  MmapSource::pageMap().set (p, SuperblockSize, MmapSource::PageMapType::Superblock);
 	  _freeSuperblocks.insert ((DLList::Entry *) p);
 	  p += SuperblockSize;
 	}
@@ -76,12 +99,21 @@ namespace Hoard {
 
   private:
 
-#if defined(__SVR4)
+#if HOARD_HUGE_PAGES
+    static_assert(HugePageSize % SuperblockSize == 0,
+		  "Superblocks must tile huge pages.");
+    enum { ChunksToGrab = HugePageSize / SuperblockSize };
+#elif defined(__SVR4)
     enum { ChunksToGrab = 1 };
 #else
     enum { ChunksToGrab = 1 };
 #endif
 
+    typedef ReservedArena<SuperblockSize,
+			  SuperblockReserveSize,
+			  SuperblockCommitSize,
+			  TheLockType> TheArena;
+
     MmapSource _superblockSource;
     DLList _freeSuperblocks;
 
@@ -35,14 +35,17 @@ namespace Hoard {
   // this in the name of robustness (turning a segfault or data
   // corruption into a potential memory leak) and because on some
   // systems, it's impossible to catch the first few allocated objects.
+  //
+  // The page map tells us whether we mapped the would-be superblock
+  // at all, so we never read memory that isn't ours.
 
-  template <class SuperHeap>
+  template <class SuperHeap,
+	    class PageMapType>
   class IgnoreInvalidFree : public SuperHeap {
   public:
     INLINE void free (void * ptr) {
       if (ptr) {
-	typename SuperHeap::SuperblockType * s = SuperHeap::getSuperblock (ptr);
-	if (!s || (!s->isValidSuperblock())) {
+	if (!isValid (ptr)) {
 	  // We encountered an invalid free, so we drop it.
 	  return;
 	}
@@ -52,8 +55,7 @@ namespace Hoard {
 
     INLINE size_t getSize (void * ptr) {
       if (ptr) {
-	typename SuperHeap::SuperblockType * s = SuperHeap::getSuperblock (ptr);
-	if (!s || (!s->isValidSuperblock())) {
+	if (!isValid (ptr)) {
 	  return 0;
 	}
 	return SuperHeap::getSize (ptr);
@@ -62,6 +64,19 @@ namespace Hoard {
       }
     }
 
+    /// @brief Did we map the chunk holding ptr (as a superblock or a
+    ///        large object)? Never reads the memory at ptr.
+    static INLINE bool isMapped (const void * ptr) {
+      return (PageMapType::getInstance().getKind (ptr) != PageMapType::Foreign);
+    }
+
+  private:
+
+    INLINE bool isValid (void * ptr) {
+      typename SuperHeap::SuperblockType * s = SuperHeap::getSuperblock (ptr);
+      return s && isMapped (s) && s->isValidSuperblock();
+    }
+
   };
 
 }
@@ -65,6 +65,19 @@ namespace Hoard {
       return slowMallocPath (sz);
     }
 
+    /// Get up to n objects, starting with the current superblock.
+    inline unsigned int mallocBatch (size_t sz, void ** ptrs, unsigned int n) {
+      unsigned int count = 0;
+      if (_current) {
+	count = _current->mallocBatch (sz, ptrs, n);
+      }
+      if (count < n) {
+	// Top off from the other superblocks.
+	count += SuperHeap::mallocBatch (sz, ptrs + count, n - count);
+      }
+      return count;
+    }
+
     /// Try to free the pointer to this superblock first.
     inline void free (void * ptr) {
       SuperblockType * s = SuperHeap::getSuperblock (ptr);
@@ -88,6 +101,24 @@ namespace Hoard {
       }
     }
 
+    /// Get an empty superblock, if there is one, and remove it.
+    SuperblockType * getEmpty() {
+      if (_current && (_current->getObjectsFree() == _current->getTotalObjects())) {
+	SuperblockType * s = _current;
+	_current = nullptr;
+	return s;
+      }
+      return SuperHeap::getEmpty();
+    }
+
+    /// Stop caching the current superblock (if any).
+    void putCurrent() {
+      if (_current) {
+	SuperHeap::put (_current);
+	_current = nullptr;
+      }
+    }
+
     /// Put the superblock into the cache.
     inline void put (SuperblockType * s) {
       if (!s || (s == _current) || (!s->isValidSuperblock())) {
@@ -36,6 +36,8 @@
 #define HOARD_TLAB_H
 
 #include "heaplayers.h"
+#include "hoardconstants.h"
+#include "trimepoch.h"
 
 #if defined(__clang__)
 #pragma clang diagnostic push
@@ -48,9 +50,11 @@ namespace Hoard {
 	    int (*getSizeClass) (size_t),
 	    size_t (*getClassSize) (int),
 	    size_t LargestObject,
+	    size_t LargestEagerObject,
 	    size_t LocalHeapThreshold,
 	    class SuperblockType,
 	    unsigned int SuperblockSize,
+	    class LargeCache,
 	    class ParentHeap>
 
   class ThreadLocalAllocationBuffer {
@@ -63,12 +67,18 @@ namespace Hoard {
 
     ThreadLocalAllocationBuffer (ParentHeap * parent)
       : _parentHeap (parent),
-      	_localHeapBytes (0)
+      	_localHeapBytes (0),
+	_nextRemote (0),
+	_epoch (TrimEpoch::current())
     {
       static_assert(gcd<Alignment, DesiredAlignment>::value == DesiredAlignment,
 		    "Alignment mismatch.");
       static_assert((Alignment >= 2 * sizeof(size_t)),
 		    "Alignment must be enough to hold two pointers.");
+      static_assert((OwnedSuperblocksPerTLAB & (OwnedSuperblocksPerTLAB - 1)) == 0,
+		    "OwnedSuperblocksPerTLAB must be a power of two.");
+      resetBudgets();
+      forgetOwned();
     }
 
     ~ThreadLocalAllocationBuffer() {
@@ -85,23 +95,35 @@ namespace Hoard {
       	sz = Alignment;
       }
 #endif
+      if (_epoch != TrimEpoch::current()) {
+	// Someone asked for memory back since we last looked.
+	trim();
+      }
       // Get memory from the local heap,
       // and deduct that amount from the local heap bytes counter.
       if (sz <= LargestObject) {
       	auto c = getSizeClass (sz);
-      	auto * ptr = _localHeap(c).get();
+      	auto& bin = _localHeap(c);
+      	auto * ptr = bin.get();
       	if (ptr) {
       	  assert (_localHeapBytes >= sz);
-      	  _localHeapBytes -= getClassSize (c); // sz; 
+      	  const auto classSize = getClassSize (c);
+      	  _localHeapBytes -= classSize;
+      	  bin.bytes -= classSize;
       	  assert (getSize(ptr) >= sz);
       	  assert ((size_t) ptr % Alignment == 0);
       	  return ptr;
       	}
+	// Out of this size: restock from the parent in bulk.
+	return refill (c, sz);
       }
 
-      // No more local memory (for this size, at least).
-      // Now get the memory from our parent.
-      auto * ptr = _parentHeap->malloc (sz);
+      // Too big for the local heap: try the large-object cache, and
+      // failing that, get the memory from our parent.
+      auto * ptr = _largeCache.malloc (sz);
+      if (!ptr) {
+	ptr = _parentHeap->malloc (sz);
+      }
       assert ((size_t) ptr % Alignment == 0);
       return ptr;
     }
@@ -109,45 +131,68 @@ namespace Hoard {
 
     inline void free (void * ptr) {
       auto * s = getSuperblock (ptr);
-      // If this isn't a valid superblock, just return.
+      // If this isn't a valid superblock, just return. (Check that we
+      // mapped it before reading its header.)
 
-      if (s->isValidSuperblock()) {
+      if (ParentHeap::isMapped (s) && s->isValidSuperblock()) {
 
       	ptr = s->normalize (ptr);
       	auto sz = s->getObjectSize ();
 
-      	if ((sz <= LargestObject) && (sz + _localHeapBytes <= LocalHeapThreshold)) {
-      	  // Free small objects locally, unless we are out of space.
-
-      	  assert (getSize(ptr) >= sizeof(HL::SLList::Entry *));
-      	  auto c = getSizeClass (sz);
-
-      	  _localHeap(c).insert ((HL::SLList::Entry *) ptr);
-      	  _localHeapBytes += getClassSize(c); // sz;
-      	  
-      	} else {
-
-      	  // Free it to the parent.
-      	  _parentHeap->free (ptr);
+      	if (sz <= LargestObject) {
+      	  if (!_parentHeap->owns (s)) {
+      	    // Another heap's memory: reusing it here would share its
+      	    // cache lines with that heap's thread, so send it home.
+      	    remoteFree (s->getOwner(), ptr);
+      	    return;
+      	  }
+      	  noteOwned (s);
+      	  if (localFree (ptr, getSizeClass (sz))) {
+      	    // Freed small objects locally.
+      	    return;
+      	  }
+      	} else if (_largeCache.free (ptr, sz, _parentHeap)) {
+      	  // Keep large objects for reuse, too.
+      	  return;
       	}
 
+      	// Free it to the parent.
+      	_parentHeap->free (ptr);
+
       } else {
       	// Illegal pointer.
       }
     }
 
+    /// @brief Free an object whose size the caller already knows,
+    ///        without touching its superblock header.
+    /// @note  sz must be at most the size the object was allocated
+    ///        with; binning it in a smaller class is harmless.
+    /// @note  Objects from superblocks we haven't seen our heap own
+    ///        lately take the regular path (which reads the header).
+    inline void freeSized (void * ptr, size_t sz) {
+      if ((sz <= LargestObject) &&
+	  isKnownOwned (getSuperblock (ptr)) &&
+	  localFree (ptr, getSizeClass (sz))) {
+	return;
+      }
+      free (ptr);
+    }
+
     void clear() {
-      // Free every object to the 'parent' heap.
+      // Free every object to the 'parent' heap, a batch at a time.
       int i = NumBins - 1;
       while ((_localHeapBytes > 0) && (i >= 0)) {
-      	auto sz = getClassSize (i);
       	while (!_localHeap(i).isEmpty()) {
-      	  auto * e = _localHeap(i).get();
-      	  _parentHeap->free (e);
-      	  _localHeapBytes -= sz;
+      	  flush (i);
       	}
       	i--;
       }
+      // Send back everything we held for other heaps.
+      for (int j = 0; j < RemoteOwnersPerTLAB; j++) {
+	flushRemote (j);
+      }
+      _largeCache.clear (_parentHeap);
     }
 
     static inline SuperblockType * getSuperblock (void * ptr) {
@@ -156,6 +201,195 @@ namespace Hoard {
 
   private:
 
+    /// Return everything we hold and start over with the initial budgets.
+    NO_INLINE void trim() {
+      _epoch = TrimEpoch::current();
+      clear();
+      resetBudgets();
+      forgetOwned();
+    }
+
+    /// @brief Remember that our heap owns superblock s.
+    /// @note  This can go stale (as superblocks move between heaps);
+    ///        the worst that does is keep another heap's object here
+    ///        until we flush it, and the parent heap rechecks then.
+    inline void noteOwned (SuperblockType * s) {
+      _owned(ownedSlotOf (s)) = s;
+    }
+
+    /// Do we remember our heap owning s? Reads only our own memory.
+    inline bool isKnownOwned (SuperblockType * s) {
+      return (_owned(ownedSlotOf (s)) == s);
+    }
+
+    /// Forget every superblock we remembered.
+    void forgetOwned() {
+      for (int i = 0; i < OwnedSuperblocksPerTLAB; i++) {
+	_owned(i) = nullptr;
+      }
+    }
+
+    static inline int ownedSlotOf (SuperblockType * s) {
+      return (int) (((size_t) s / SuperblockSize) & (OwnedSuperblocksPerTLAB - 1));
+    }
+
+    /// Only cache small size classes until the others prove hot.
+    void resetBudgets() {
+      for (int c = 0; c < NumBins; c++) {
+	auto& bin = _localHeap(c);
+	bin.limit = (getClassSize (c) <= LargestEagerObject) ? InitialBytesPerTLABClass : 0;
+	bin.misses = 0;
+      }
+    }
+
+    /// @brief Cache an object of size class c, unless it is over budget.
+    /// @return true iff the object is now in the local heap.
+    inline bool localFree (void * ptr, int c) {
+      auto& bin = _localHeap(c);
+      const auto classSize = getClassSize (c);
+      if (bin.limit == 0) {
+	// We don't cache this size (yet).
+	return false;
+      }
+      if (bin.bytes + classSize > bin.limit) {
+	// This thread frees more of this size than it allocates:
+	// return a batch and lower the budget.
+	flush (c);
+	bin.limit /= 2;
+	if (bin.limit < MinBytesPerTLABClass) {
+	  bin.limit = MinBytesPerTLABClass;
+	}
+      } else if (classSize + _localHeapBytes > LocalHeapThreshold) {
+	// Out of space: make room by returning a batch of this size.
+	flush (c);
+      }
+      if ((bin.bytes + classSize > bin.limit) ||
+	  (classSize + _localHeapBytes > LocalHeapThreshold)) {
+	return false;
+      }
+      assert (getSize(ptr) >= sizeof(HL::SLList::Entry *));
+      bin.insert ((HL::SLList::Entry *) ptr);
+      bin.bytes += classSize;
+      _localHeapBytes += classSize;
+      return true;
+    }
+
+    /// Return up to MaxObjectsPerFlush objects of size class c to the parent heap.
+    NO_INLINE void flush (int c) {
+      auto& bin = _localHeap(c);
+      void * ptrs[MaxObjectsPerFlush];
+      unsigned int n = 0;
+      while (n < MaxObjectsPerFlush) {
+	auto * e = bin.get();
+	if (!e) {
+	  break;
+	}
+	ptrs[n++] = e;
+      }
+      if (n > 0) {
+	const auto bytes = n * getClassSize (c);
+	bin.bytes -= bytes;
+	_localHeapBytes -= bytes;
+	_parentHeap->freeBatch (ptrs, n);
+      }
+    }
+
+    /// Hold an object owned by another heap, to return it with others
+    /// from the same owner.
+    NO_INLINE void remoteFree (const void * owner, void * ptr) {
+      int i = -1;
+      for (int j = 0; j < RemoteOwnersPerTLAB; j++) {
+	if (_remote(j).owner == owner) {
+	  i = j;
+	  break;
+	}
+	if ((i < 0) && (_remote(j).count == 0)) {
+	  i = j;
+	}
+      }
+      if (i < 0) {
+	// No room for another owner: evict one, round-robin.
+	i = (int) _nextRemote;
+	_nextRemote = (_nextRemote + 1) % RemoteOwnersPerTLAB;
+	flushRemote (i);
+      }
+      auto& b = _remote(i);
+      b.owner = owner;
+      b.ptrs[b.count++] = ptr;
+      if (b.count == MaxObjectsPerFlush) {
+	flushRemote (i);
+      }
+    }
+
+    /// Return every object held for the i-th owner at once.
+    void flushRemote (int i) {
+      auto& b = _remote(i);
+      if (b.count > 0) {
+	// The parent heap rechecks ownership, which may have changed.
+	_parentHeap->freeBatch (b.ptrs, b.count);
+	b.count = 0;
+      }
+      b.owner = nullptr;
+    }
+
+    /// Get a batch of objects of size class c from the parent heap,
+    /// returning one and keeping the rest in the local heap.
+    NO_INLINE void * refill (int c, size_t sz) {
+      auto& bin = _localHeap(c);
+      const auto classSize = getClassSize (c);
+      if (bin.limit == 0) {
+	// Start caching a size once it proves hot.
+	if (++bin.misses < HotClassMisses) {
+	  auto * ptr = _parentHeap->malloc (sz);
+	  assert ((size_t) ptr % Alignment == 0);
+	  return ptr;
+	}
+	bin.limit = InitialBytesPerTLABClass;
+      } else if (bin.limit < MaxBytesPerTLABClass) {
+	// Running dry means this thread allocates more of this size
+	// than it frees: let it keep more around.
+	bin.limit += MaxBytesPerRefill;
+	if (bin.limit > MaxBytesPerTLABClass) {
+	  bin.limit = MaxBytesPerTLABClass;
+	}
+      }
+      auto n = (size_t) MaxBytesPerRefill / classSize;
+      if (n > MaxObjectsPerRefill) {
+	n = MaxObjectsPerRefill;
+      }
+      // Stay under this size's budget and the local heap threshold.
+      auto room = (bin.limit - bin.bytes) / classSize + 1;
+      if (n > room) {
+	n = room;
+      }
+      room = (LocalHeapThreshold - _localHeapBytes) / classSize + 1;
+      if (n > room) {
+	n = room;
+      }
+      if (n <= 1) {
+	auto * ptr = _parentHeap->malloc (sz);
+	assert ((size_t) ptr % Alignment == 0);
+	return ptr;
+      }
+      void * ptrs[MaxObjectsPerRefill];
+      auto count = _parentHeap->mallocBatch (classSize, ptrs, (unsigned int) n);
+      if (count == 0) {
+	return nullptr;
+      }
+      for (auto i = 1U; i < count; i++) {
+	bin.insert ((HL::SLList::Entry *) ptrs[i]);
+      }
+      // Our heap just handed these out, so it owns their superblocks.
+      for (auto i = 0U; i < count; i++) {
+	noteOwned (getSuperblock (ptrs[i]));
+      }
+      bin.bytes += (count - 1) * classSize;
+      _localHeapBytes += (count - 1) * classSize;
+      assert (getSize(ptrs[0]) >= sz);
+      assert ((size_t) ptrs[0] % Alignment == 0);
+      return ptrs[0];
+    }
+
     // Disable assignment and copying.
 
     ThreadLocalAllocationBuffer (const ThreadLocalAllocationBuffer&);
@@ -170,8 +404,59 @@ namespace Hoard {
     /// The number of bytes we currently have on this thread.
     size_t _localHeapBytes;
 
+    /// One size class of the local heap, with its adaptive budget.
+    class LocalBin : public HL::SLList {
+    public:
+      LocalBin()
+	: bytes (0),
+	  limit (0),
+	  misses (0)
+      {}
+
+      /// The number of bytes held in this bin.
+      size_t bytes;
+
+      /// The most bytes this bin may hold (0 = uncached).
+      size_t limit;
+
+      /// Trips to the parent heap while uncached.
+      unsigned int misses;
+    };
+
+    /// Objects freed here that belong to some other heap.
+    class RemoteBuffer {
+    public:
+      RemoteBuffer()
+	: owner (nullptr),
+	  count (0)
+      {}
+
+      /// The heap that owns these objects' superblocks.
+      const void * owner;
+
+      /// The number of objects held.
+      unsigned int count;
+
+      void * ptrs[MaxObjectsPerFlush];
+    };
+
+    /// The next remote buffer to evict when all are taken.
+    unsigned int _nextRemote;
+
+    /// The trim epoch we last saw.
+    unsigned long _epoch;
+
     /// The local heap itself.
-    Array<NumBins, HL::SLList> _localHeap;
+    Array<NumBins, LocalBin> _localHeap;
+
+    /// Objects waiting to go back to their owners.
+    Array<RemoteOwnersPerTLAB, RemoteBuffer> _remote;
+
+    /// Large objects freed here, kept for reuse.
+    LargeCache _largeCache;
+
+    /// Superblocks we've lately seen our heap own, by address.
+    Array<OwnedSuperblocksPerTLAB, SuperblockType *> _owned;
   };
 
 }
@@ -34,8 +34,12 @@
 #ifndef HOARD_ALIGNEDMMAP_H
 #define HOARD_ALIGNEDMMAP_H
 
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
 #include "heaplayers.h"
-#include "mmapalloc.h"
+#include "pagemap.h"
 
 using namespace std;
 using namespace HL;
@@ -48,20 +52,15 @@ namespace Hoard {
    * @author Emery Berger <http://www.cs.umass.edu/~emery>
    */
 
-  template <size_t Alignment,
-	    class LockType>
-  class AlignedMmap;
-
   template <size_t Alignment_>
   class AlignedMmapInstance {
   public:
 
-    AlignedMmapInstance()
-      : MyMap (16381) // entries in the hash map.
-    {}
-
     enum { Alignment = Alignment_ };
 
+    /// Where we record every mapping (shared by all instances).
+    typedef PageMap<Alignment_> PageMapType;
+
     void clear() {
       // NOP: this heap never holds any memory.
     }
@@ -71,31 +70,57 @@ namespace Hoard {
       // Round up sz to the nearest page.
       sz = HL::align<HL::MmapWrapper::Size>(sz);
 
-      // If the memory is already suitably aligned, just track size requests.
-      if ((size_t) HL::MmapWrapper::Alignment % (size_t) Alignment == 0) {
-	void * ptr = HL::MmapWrapper::map (sz);
-	MyMap.set (ptr, sz);
-	assert ((size_t) ptr % Alignment == 0);
-	return ptr;
+      void * ptr = map (sz);
+      if (ptr && !pageMap().set (ptr, sz, PageMapType::LargeObject)) {
+	HL::MmapWrapper::unmap (ptr, sz);
+	return nullptr;
       }
+      return ptr;
+    }
 
-      void * ptr = nullptr;
-
-      // Try a map call and hope that it's suitably aligned. If we get lucky,
-      // we're done.
-
-      ptr = HL::MmapWrapper::map (sz);
-
-      if ((size_t) ptr == HL::align<Alignment>((size_t) ptr)) {
-	// We're done.
-	MyMap.set (ptr, sz);
+    /// @brief Resize the mapping at ptr to (at least) sz bytes, without
+    ///        copying: grow it in place if the pages after it are free,
+    ///        or else move its pages to a fresh aligned spot.
+    /// @return its (possibly new) address, or null if we can't (in which
+    ///         case the mapping is unchanged).
+    void * resize (void * ptr, size_t sz) {
+#if defined(__linux__) && defined(MREMAP_MAYMOVE)
+      auto oldSize = getSize (ptr);
+      if (oldSize == 0) {
+	return nullptr;
+      }
+      sz = HL::align<HL::MmapWrapper::Size>(sz);
+      if (sz == oldSize) {
 	return ptr;
       }
-
-      // Try again.
-      HL::MmapWrapper::unmap ((void *) ptr, sz);
-
-      return slowMap (sz);
+      // Shrinking (which releases the tail pages) always works in
+      // place, and growing does if nothing is in the way.
+      const auto kind = pageMap().getKind (ptr);
+      if (mremap (ptr, oldSize, sz, 0) != MAP_FAILED) {
+	pageMap().set (ptr, sz, kind);
+	return ptr;
+      }
+      auto * dest = map (sz);
+      if (!dest || !pageMap().set (dest, sz, kind)) {
+	if (dest) {
+	  HL::MmapWrapper::unmap (dest, sz);
+	}
+	return nullptr;
+      }
+      // Forget ptr before its pages go, since someone may map them again at once.
+      pageMap().clear (ptr);
+      if (mremap (ptr, oldSize, sz, MREMAP_MAYMOVE | MREMAP_FIXED, dest) == MAP_FAILED) {
+	pageMap().set (ptr, oldSize, kind);
+	pageMap().clear (dest);
+	HL::MmapWrapper::unmap (dest, sz);
+	return nullptr;
+      }
+      return dest;
+#else
+      (void) ptr;
+      (void) sz;
+      return nullptr;
+#endif
     }
 
     inline void free (void * ptr) {
@@ -109,19 +134,53 @@ namespace Hoard {
 	return;
       }
 
-      HL::MmapWrapper::unmap (ptr, requestedSize);
+      // Undo the mapping first: once the pages go, someone may map
+      // them again at once.
+      pageMap().clear (ptr);
 
-      // Finally, undo the mapping.
-      MyMap.erase (ptr);
+      HL::MmapWrapper::unmap (ptr, requestedSize);
     }
   
     inline size_t getSize (void * ptr) {
-      return MyMap.get (ptr);
+      // Only the start of a mapping counts.
+      if ((size_t) ptr % Alignment != 0) {
+	return 0;
+      }
+      return pageMap().getSize (ptr);
+    }
+
+    static inline PageMapType& pageMap() {
+      return PageMapType::getInstance();
     }
 
 
   private:
 
+    /// Map sz bytes (a multiple of the page size), suitably aligned.
+    void * map (size_t sz) {
+
+      // If the memory is already suitably aligned, we're done.
+      if ((size_t) HL::MmapWrapper::Alignment % (size_t) Alignment == 0) {
+	void * ptr = HL::MmapWrapper::map (sz);
+	assert ((size_t) ptr % Alignment == 0);
+	return ptr;
+      }
+
+      // Try a map call and hope that it's suitably aligned. If we get lucky,
+      // we're done.
+
+      void * ptr = HL::MmapWrapper::map (sz);
+
+      if ((size_t) ptr == HL::align<Alignment>((size_t) ptr)) {
+	return ptr;
+      }
+
+      // Try again.
+      HL::MmapWrapper::unmap ((void *) ptr, sz);
+
+      return slowMap (sz);
+    }
+
     void * slowMap (size_t sz) {
 
       // We have to align it ourselves. We get memory from
@@ -149,44 +208,61 @@ namespace Hoard {
       size_t epilog = Alignment - prolog;
       HL::MmapWrapper::unmap ((char *) newptr + sz, epilog);
 
-      // Now record the size associated with this pointer.
-
-      MyMap.set (newptr, sz);
       return newptr;
     }
 
-    // Manage information in a map that uses a custom heap for
-    // allocation.
-
-    /// The key is an mmapped pointer.
-    typedef void * keyType;
-
-    /// The value is the requested size.
-    typedef size_t valType;
-
-    // The heap from which memory comes for the Map's purposes.
-    // Objects come from chunks via mmap, and we manage these with a free list.
-    class SourceHeap : public HL::FreelistHeap<BumpAlloc<65536, MmapAlloc> > { };
-
-    /// The map type, with all the pieces in place.
-    typedef MyHashMap<keyType, valType, SourceHeap> mapType;
-
-    /// The map that maintains the size of each mmapped chunk.
-    mapType MyMap;
-
   };
 
 
   /**
    * @class AlignedMmap
    * @brief Route requests to the one aligned mmap instance.
+   * @note  This takes no lock: the kernel serializes mappings, and the
+   *        page map takes concurrent updates and lookups.
    * @author Emery Berger <http://www.cs.umass.edu/~emery>
    */
 
-  template <size_t Alignment_,
-	    class LockType>
-  class AlignedMmap :
-    public ExactlyOneHeap<LockedHeap<LockType, AlignedMmapInstance<Alignment_> > > {};
+  template <size_t Alignment_>
+  class AlignedMmap {
+  public:
+
+    enum { Alignment = Alignment_ };
+
+    typedef typename AlignedMmapInstance<Alignment_>::PageMapType PageMapType;
+
+    inline void * malloc (size_t sz) {
+      return getInstance().malloc (sz);
+    }
+
+    inline void free (void * ptr) {
+      getInstance().free (ptr);
+    }
+
+    inline size_t getSize (void * ptr) {
+      return getInstance().getSize (ptr);
+    }
+
+    /// Resize a mapping (see AlignedMmapInstance::resize).
+    inline void * resize (void * ptr, size_t sz) {
+      return getInstance().resize (ptr, sz);
+    }
+
+    void clear() {
+    }
+
+    /// Where every mapping is recorded.
+    static inline PageMapType& pageMap() {
+      return PageMapType::getInstance();
+    }
+
+  private:
+
+    static AlignedMmapInstance<Alignment_>& getInstance() {
+      static AlignedMmapInstance<Alignment_> instance;
+      return instance;
+    }
+
+  };
 
 }
 
@@ -0,0 +1,81 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+
+
+#ifndef HOARD_CURRENTCPU_H
+#define HOARD_CURRENTCPU_H
+
+#if defined(__linux__)
+#include <sched.h>
+// glibc registers a restartable sequence (rseq) area for every thread
+// as of 2.35; the kernel keeps its cpu_id field current.
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ >= 35)))
+#include <sys/rseq.h>
+#define HOARD_USE_RSEQ 1
+#endif
+#endif
+
+#include "heaplayers.h"
+
+namespace Hoard {
+
+  /**
+   * @class CurrentCPU
+   * @brief Finds out which CPU the calling thread is running on.
+   */
+
+  class CurrentCPU {
+  public:
+
+    /// @return the CPU this thread is (probably) running on.
+    static inline int get() {
+#if defined(HOARD_USE_RSEQ)
+      if (__rseq_size > 0) {
+	auto * rs = reinterpret_cast<volatile struct rseq *>
+	  (reinterpret_cast<char *>(__builtin_thread_pointer()) + __rseq_offset);
+	auto cpu = (int) rs->cpu_id;
+	if (cpu >= 0) {
+	  return cpu;
+	}
+      }
+#endif
+#if defined(__linux__)
+      auto cpu = sched_getcpu();
+      if (cpu >= 0) {
+	return cpu;
+      }
+#endif
+      // No way to tell: spread threads around instead.
+      return (int) HL::CPUInfo::getThreadId();
+    }
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,146 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.emeryberger.com
+
+  Copyright (c) 1998-2018 Emery Berger
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+#ifndef HOARD_FUTEXLOCK_H
+#define HOARD_FUTEXLOCK_H
+
+#if defined(__linux__)
+
+#include <atomic>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "heaplayers.h"
+
+namespace Hoard {
+
+  /**
+   * @class Futex
+   * @brief The bare futex calls, plus a polite way to spin.
+   */
+
+  class Futex {
+  public:
+
+    /// Sleep as long as *addr == val (or until woken, or spuriously).
+    static inline void wait (std::atomic<int>& addr, int val) {
+      syscall (SYS_futex, reinterpret_cast<int *>(&addr), FUTEX_WAIT_PRIVATE, val, nullptr, nullptr, 0);
+    }
+
+    /// Wake one thread sleeping on addr.
+    static inline void wakeOne (std::atomic<int>& addr) {
+      syscall (SYS_futex, reinterpret_cast<int *>(&addr), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+
+    /// Tell the CPU we're spinning.
+    static inline void pause() {
+#if defined(__i386__) || defined(__x86_64__)
+      __builtin_ia32_pause();
+#elif defined(__aarch64__)
+      asm volatile ("yield");
+#endif
+    }
+
+  };
+
+  /**
+   * @class FutexLock
+   * @brief A lock that spins briefly, then sleeps in the kernel.
+   * @note  Spinning wins when the holder is running and about to let
+   *        go; sleeping wins when it has been descheduled (e.g., with
+   *        more runnable threads than CPUs, or a container CPU quota).
+   */
+
+  class FutexLock {
+  public:
+
+    FutexLock()
+      : _state (Unlocked),
+	_contentions (0)
+    {}
+
+    inline void lock() {
+      auto s = (int) Unlocked;
+      if (!_state.compare_exchange_strong (s, Locked,
+					   std::memory_order_acquire,
+					   std::memory_order_relaxed)) {
+	contendedLock();
+      }
+    }
+
+    inline bool try_lock() {
+      auto s = (int) Unlocked;
+      return _state.compare_exchange_strong (s, Locked,
+					     std::memory_order_acquire,
+					     std::memory_order_relaxed);
+    }
+
+    inline void unlock() {
+      if (_state.exchange (Unlocked, std::memory_order_release) == Contended) {
+	Futex::wakeOne (_state);
+      }
+    }
+
+    /// How many times a thread has found this lock taken.
+    inline unsigned int contentions() const {
+      return _contentions.load (std::memory_order_relaxed);
+    }
+
+  private:
+
+    /// How many times to retry before going to sleep.
+    enum { SpinCount = 100 };
+
+    enum { Unlocked = 0, Locked = 1, Contended = 2 };
+
+    NO_INLINE void contendedLock() {
+      _contentions.fetch_add (1, std::memory_order_relaxed);
+      for (auto i = 0; i < SpinCount; i++) {
+	Futex::pause();
+	if ((_state.load (std::memory_order_relaxed) == Unlocked) && try_lock()) {
+	  return;
+	}
+      }
+      // Mark the lock contended (so the holder wakes us), and sleep.
+      while (_state.exchange (Contended, std::memory_order_acquire) != Unlocked) {
+	Futex::wait (_state, Contended);
+      }
+    }
+
+    std::atomic<int> _state;
+
+    std::atomic<unsigned int> _contentions;
+
+  };
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,87 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.emeryberger.org
+ 
+  Copyright (c) 1998-2018 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/**
+ * @file hugepageregion.h
+ * @author Emery Berger <http://www.emeryberger.com>
+ */
+
+
+#ifndef HOARD_HUGEPAGEREGION_H
+#define HOARD_HUGEPAGEREGION_H
+
+#include "heaplayers.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace Hoard {
+
+  /**
+   * @class HugePageRegion
+   * @brief Maps RegionSize-aligned regions and asks the kernel to
+   *        back them with transparent huge pages.
+   * @note  Regions are never unmapped.
+   */
+
+  template <size_t RegionSize>
+  class HugePageRegion {
+  public:
+
+    enum { Alignment = RegionSize };
+
+    /// @return a fresh region, or null if we're out of address space.
+    static void * map() {
+      static_assert((RegionSize & (RegionSize - 1)) == 0,
+		    "Region size must be a power of two.");
+      // Over-allocate, then trim the mapping to an aligned region.
+      auto * ptr = reinterpret_cast<char *>(HL::MmapWrapper::map (RegionSize + RegionSize));
+      if (ptr == nullptr) {
+	return nullptr;
+      }
+      auto * region = reinterpret_cast<char *>(HL::align<RegionSize>((size_t) ptr));
+      const size_t prolog = region - ptr;
+      if (prolog > 0) {
+	HL::MmapWrapper::unmap (ptr, prolog);
+      }
+      const size_t epilog = RegionSize - prolog;
+      if (epilog > 0) {
+	HL::MmapWrapper::unmap (region + RegionSize, epilog);
+      }
+#if defined(MADV_HUGEPAGE)
+      // Only a hint: without THP, we just get ordinary pages.
+      madvise (region, RegionSize, MADV_HUGEPAGE);
+#endif
+      return region;
+    }
+
+  };
+
+}
+
+#endif
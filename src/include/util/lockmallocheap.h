@@ -44,6 +44,14 @@ namespace Hoard {
       std::lock_guard<Heap> l (*this);
       return Heap::malloc (sz);
     }
+    INLINE unsigned int mallocBatch (size_t sz, void ** ptrs, unsigned int n) {
+      std::lock_guard<Heap> l (*this);
+      return Heap::mallocBatch (sz, ptrs, n);
+    }
+    NO_INLINE void scavenge() {
+      std::lock_guard<Heap> l (*this);
+      Heap::scavenge();
+    }
   };
 
 }
@@ -0,0 +1,166 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.emeryberger.com
+
+  Copyright (c) 1998-2018 Emery Berger
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+#ifndef HOARD_MCSLOCK_H
+#define HOARD_MCSLOCK_H
+
+#if defined(__linux__)
+
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+
+#include "futexlock.h"
+
+namespace Hoard {
+
+  /**
+   * @class MCSLock
+   * @brief A fair (first-come, first-served) queue lock, after
+   *        Mellor-Crummey and Scott.
+   * @note  Each waiter spins on its own queue node, so a handoff costs
+   *        one cache miss however many threads wait. Waiters that spin
+   *        too long sleep on their node until their turn comes.
+   * @note  Queue nodes come from a small per-thread pool, which bounds
+   *        how many of these locks one thread may hold at once.
+   */
+
+  class MCSLock {
+  public:
+
+    MCSLock()
+      : _tail (nullptr),
+	_holder (nullptr)
+    {}
+
+    void lock() {
+      auto * me = claimNode();
+      me->next.store (nullptr, std::memory_order_relaxed);
+      me->state.store (Waiting, std::memory_order_relaxed);
+      auto * prev = _tail.exchange (me, std::memory_order_acq_rel);
+      if (prev) {
+	// Get in line behind prev, and wait for it to hand over.
+	prev->next.store (me, std::memory_order_release);
+	waitForTurn (me);
+      }
+      _holder = me;
+    }
+
+    void unlock() {
+      auto * me = _holder;
+      auto * next = me->next.load (std::memory_order_acquire);
+      if (!next) {
+	auto * expected = me;
+	if (_tail.compare_exchange_strong (expected, nullptr,
+					   std::memory_order_release,
+					   std::memory_order_relaxed)) {
+	  // Nobody was waiting.
+	  releaseNode (me);
+	  return;
+	}
+	// Someone is getting in line; wait for them to link up.
+	while (!(next = me->next.load (std::memory_order_acquire))) {
+	  Futex::pause();
+	}
+      }
+      releaseNode (me);
+      if (next->state.exchange (Go, std::memory_order_release) == Sleeping) {
+	Futex::wakeOne (next->state);
+      }
+    }
+
+  private:
+
+    /// How many times a waiter checks its node before going to sleep.
+    enum { SpinCount = 100 };
+
+    /// The most of these locks one thread may hold at once.
+    enum { MaxHeldLocks = 8 };
+
+    enum { Go = 0, Waiting = 1, Sleeping = 2 };
+
+    class Node {
+    public:
+      std::atomic<Node *> next;
+      std::atomic<int> state;
+      bool inUse;
+    };
+
+    static void waitForTurn (Node * me) {
+      for (auto i = 0; i < SpinCount; i++) {
+	if (me->state.load (std::memory_order_acquire) == Go) {
+	  return;
+	}
+	Futex::pause();
+      }
+      auto s = (int) Waiting;
+      if (me->state.compare_exchange_strong (s, Sleeping,
+					     std::memory_order_acquire,
+					     std::memory_order_acquire)) {
+	while (me->state.load (std::memory_order_acquire) != Go) {
+	  Futex::wait (me->state, Sleeping);
+	}
+      }
+    }
+
+    static Node * claimNode() {
+      auto * nodes = getNodes();
+      for (auto i = 0; i < MaxHeldLocks; i++) {
+	if (!nodes[i].inUse) {
+	  nodes[i].inUse = true;
+	  return &nodes[i];
+	}
+      }
+      // Holding too many of these at once.
+      assert (false);
+      abort();
+      return nullptr;
+    }
+
+    static inline void releaseNode (Node * n) {
+      n->inUse = false;
+    }
+
+    static inline Node * getNodes() {
+      // Initial-exec TLS never allocates (so it can't recurse into malloc).
+      static __thread Node nodes[MaxHeldLocks] __attribute__((tls_model ("initial-exec")));
+      return nodes;
+    }
+
+    /// The last thread in line (or null if the lock is free).
+    std::atomic<Node *> _tail;
+
+    /// The node of the thread holding the lock.
+    Node * _holder;
+
+  };
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,212 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+
+
+
+#ifndef HOARD_NUMATOPOLOGY_H
+#define HOARD_NUMATOPOLOGY_H
+
+#include <cstddef>
+#include <cstdlib>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "currentcpu.h"
+#include "hoardconstants.h"
+
+namespace Hoard {
+
+  /**
+   * @class NUMATopology
+   * @brief Which memory node each CPU belongs to.
+   *
+   * Read once from /sys/devices/system/node/node<N>/cpulist or, if
+   * HOARD_NUMA_TOPOLOGY names a file, from that file instead: one
+   * cpulist (e.g., "0-3,8-11") per line, for nodes 0, 1, and so on.
+   * Without either, there is just node 0.
+   */
+
+  class NUMATopology {
+  public:
+
+    /// @return the number of memory nodes (at least 1).
+    static inline int getNumNodes() {
+      return getMap().numNodes;
+    }
+
+    /// @return the node of the CPU this thread is (probably) running on.
+    static inline int getCurrentNode() {
+      auto& m = getMap();
+      if (m.numNodes == 1) {
+	return 0;
+      }
+      auto cpu = (unsigned int) CurrentCPU::get();
+      return (cpu < MaxCPUsPerMap) ? m.nodeOf[cpu] : 0;
+    }
+
+    /// Ask the OS to place the pages of [ptr, ptr+sz) on the given node.
+    static void bind (void * ptr, size_t sz, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+      if (getNumNodes() == 1) {
+	return;
+      }
+      unsigned long mask = 1UL << node;
+      // Prefer (rather than insist on) the node, and move any pages
+      // that are already there. Failure is harmless.
+      syscall (SYS_mbind, ptr, sz, MPOL_PREFERRED, &mask, sizeof(mask) * 8, MPOL_MF_MOVE);
+#else
+      (void) ptr;
+      (void) sz;
+      (void) node;
+#endif
+    }
+
+  private:
+
+    enum { MaxCPUsPerMap = 1024 };
+
+    class Map {
+    public:
+      Map()
+	: numNodes (1)
+      {
+	for (auto i = 0; i < MaxCPUsPerMap; i++) {
+	  nodeOf[i] = 0;
+	}
+#if defined(__linux__)
+	auto * file = getenv ("HOARD_NUMA_TOPOLOGY");
+	if (file) {
+	  readOverride (file);
+	} else {
+	  readSysfs();
+	}
+#endif
+      }
+
+      int numNodes;
+      unsigned char nodeOf[MaxCPUsPerMap];
+
+    private:
+
+#if defined(__linux__)
+      /// Read a (small) file into buf, null-terminated.
+      /// @note We may be in the middle of a malloc: no stdio.
+      static bool readFile (const char * name, char * buf, size_t len) {
+	auto fd = open (name, O_RDONLY);
+	if (fd < 0) {
+	  return false;
+	}
+	auto n = read (fd, buf, len - 1);
+	close (fd);
+	buf[(n > 0) ? n : 0] = '\0';
+	return (n > 0);
+      }
+
+      void readSysfs() {
+	static const char prefix[] = "/sys/devices/system/node/node";
+	static const char suffix[] = "/cpulist";
+	char name[sizeof(prefix) + sizeof(suffix) + 8];
+	char buf[1024];
+	for (auto node = 0; node < MaxNUMANodes; node++) {
+	  // name = prefix + node + suffix
+	  char digits[8];
+	  auto nd = 0;
+	  auto v = node;
+	  do {
+	    digits[nd++] = (char) ('0' + v % 10);
+	    v /= 10;
+	  } while (v > 0);
+	  auto * q = name;
+	  for (auto * c = prefix; *c; c++) {
+	    *q++ = *c;
+	  }
+	  while (nd > 0) {
+	    *q++ = digits[--nd];
+	  }
+	  for (auto * c = suffix; *c; c++) {
+	    *q++ = *c;
+	  }
+	  *q = '\0';
+	  if (readFile (name, buf, sizeof(buf))) {
+	    parseCPUList (buf, node);
+	  }
+	}
+      }
+
+      void readOverride (const char * file) {
+	char buf[4096];
+	if (!readFile (file, buf, sizeof(buf))) {
+	  return;
+	}
+	auto * line = buf;
+	for (auto node = 0; (node < MaxNUMANodes) && line && *line; node++) {
+	  line = parseCPUList (line, node);
+	}
+      }
+
+      /// Assign the CPUs in a cpulist to node, returning where the next line starts.
+      char * parseCPUList (char * p, int node) {
+	while (*p && (*p != '\n')) {
+	  char * end;
+	  auto first = strtoul (p, &end, 10);
+	  if (end == p) {
+	    p++;
+	    continue;
+	  }
+	  auto last = first;
+	  if (*end == '-') {
+	    last = strtoul (end + 1, &end, 10);
+	  }
+	  for (auto cpu = first; (cpu <= last) && (cpu < MaxCPUsPerMap); cpu++) {
+	    nodeOf[cpu] = (unsigned char) node;
+	    if (node >= numNodes) {
+	      numNodes = node + 1;
+	    }
+	  }
+	  p = end;
+	}
+	return (*p == '\n') ? p + 1 : p;
+      }
+#endif
+    };
+
+    static const Map& getMap() {
+      static Map map;
+      return map;
+    }
+
+  };
+
+}
+
+#endif
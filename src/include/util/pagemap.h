@@ -0,0 +1,174 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.emeryberger.com
+
+  Copyright (c) 1998-2018 Emery Berger
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/**
+ * @file pagemap.h
+ * @author Emery Berger <http://www.emeryberger.com>
+ */
+
+#ifndef HOARD_PAGEMAP_H
+#define HOARD_PAGEMAP_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include "heaplayers.h"
+
+namespace Hoard {
+
+  /**
+   * @class PageMap
+   * @brief A two-level radix tree that records, for each ChunkSize-aligned
+   *        chunk of the address space where one of our mappings starts,
+   *        the mapping's size and what it holds.
+   * @note  Lookups take no lock and never touch the memory they ask
+   *        about, so they are safe on any pointer at all.
+   * @note  Leaves (each covering 2^(LeafBits + log2 ChunkSize) bytes of
+   *        address space) are mapped on first use and never freed.
+   */
+
+  template <size_t ChunkSize,
+	    int AddressBits = 48>
+  class PageMap {
+  public:
+
+    /// What a chunk holds. Anything we didn't map is Foreign.
+    enum Kind { Foreign = 0, Superblock = 1, LargeObject = 2 };
+
+    constexpr PageMap()
+      : _root {}
+    {}
+
+    /// The one page map for chunks of this size.
+    static PageMap& getInstance() {
+      // Constant-initialized, so this lives in zeroed memory and costs
+      // nothing until used.
+      static PageMap theMap;
+      return theMap;
+    }
+
+    /// @brief Record that a mapping of sz bytes and kind k starts at ptr.
+    /// @return false if we can't (ptr is out of range, or no memory).
+    bool set (void * ptr, size_t sz, Kind k) {
+      assert ((uintptr_t) ptr % ChunkSize == 0);
+      assert ((sz & KindMask) == 0);
+      auto * e = entry (ptr, true);
+      if (!e) {
+	return false;
+      }
+      e->store (sz | k, std::memory_order_release);
+      return true;
+    }
+
+    /// Forget the mapping that starts at ptr.
+    void clear (void * ptr) {
+      auto * e = entry (ptr, false);
+      if (e) {
+	e->store (0, std::memory_order_release);
+      }
+    }
+
+    /// @return the size of the mapping starting at the chunk holding ptr (or 0).
+    size_t getSize (const void * ptr) const {
+      return lookup (ptr) & ~(uintptr_t) KindMask;
+    }
+
+    /// @return what the chunk holding ptr holds.
+    Kind getKind (const void * ptr) const {
+      return (Kind) (lookup (ptr) & KindMask);
+    }
+
+  private:
+
+    static constexpr int log2 (size_t n) {
+      return (n <= 1) ? 0 : 1 + log2 (n / 2);
+    }
+
+    enum { ChunkBits = log2 (ChunkSize) };
+    enum { KeyBits = AddressBits - ChunkBits };
+    enum { LeafBits = KeyBits / 2 };
+    enum { RootBits = KeyBits - LeafBits };
+    enum { LeafEntries = 1UL << LeafBits };
+    enum { RootEntries = 1UL << RootBits };
+
+    /// Sizes are multiples of the page size, so kinds fit in the low bits.
+    enum { KindMask = 3 };
+
+    static_assert((1UL << ChunkBits) == ChunkSize,
+		  "Chunk size must be a power of two.");
+
+    typedef std::atomic<uintptr_t> Entry;
+
+    inline uintptr_t lookup (const void * ptr) const {
+      const auto key = (uintptr_t) ptr >> ChunkBits;
+      if (key >> KeyBits) {
+	return 0;
+      }
+      auto * leaf = _root[key >> LeafBits].load (std::memory_order_acquire);
+      if (!leaf) {
+	return 0;
+      }
+      return leaf[key & (LeafEntries - 1)].load (std::memory_order_acquire);
+    }
+
+    Entry * entry (void * ptr, bool create) {
+      const auto key = (uintptr_t) ptr >> ChunkBits;
+      if (key >> KeyBits) {
+	return nullptr;
+      }
+      auto& slot = _root[key >> LeafBits];
+      auto * leaf = slot.load (std::memory_order_acquire);
+      if (!leaf && create) {
+	// Fresh mappings are zeroed, i.e., all Foreign.
+	auto * fresh = reinterpret_cast<Entry *>(HL::MmapWrapper::map (LeafEntries * sizeof(Entry)));
+	if (!fresh) {
+	  return nullptr;
+	}
+	if (slot.compare_exchange_strong (leaf, fresh,
+					  std::memory_order_acq_rel,
+					  std::memory_order_acquire)) {
+	  leaf = fresh;
+	} else {
+	  // Someone beat us to it.
+	  HL::MmapWrapper::unmap (fresh, LeafEntries * sizeof(Entry));
+	}
+      }
+      if (!leaf) {
+	return nullptr;
+      }
+      return &leaf[key & (LeafEntries - 1)];
+    }
+
+    std::atomic<Entry *> _root[RootEntries];
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,128 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.cs.umass.edu/~emery
+ 
+  Copyright (c) 1998-2012 Emery Berger
+  
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+  
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+
+#ifndef HOARD_PERCPUHEAP_H
+#define HOARD_PERCPUHEAP_H
+
+#include <cassert>
+#include <mutex>
+#include <new>
+
+#include "currentcpu.h"
+#include "heaplayers.h"
+
+/**
+ * @class PerCPUHeap
+ * @brief Front-end caches shared by all threads running on the same CPU.
+ *
+ * Each CPU gets its own CacheType (e.g., a TLAB), so cached memory
+ * grows with the number of cores instead of the number of threads.
+ * A thread can be preempted or migrated while it uses a cache, so
+ * each one is guarded by a lock; it is all but uncontended, since
+ * only threads that share a CPU can collide.
+ */
+
+namespace Hoard {
+
+  template <int NumCPUs,
+	    class LockType,
+	    class CacheType>
+  class PerCPUHeap {
+  public:
+
+    enum { Alignment = CacheType::Alignment };
+
+    template <class ParentHeap>
+    PerCPUHeap (ParentHeap * parent)
+    {
+      static_assert((NumCPUs & (NumCPUs - 1)) == 0,
+		    "Number of CPUs must be a power of two.");
+      for (auto i = 0; i < NumCPUs; i++) {
+	new (&_caches[i].buf) CacheType (parent);
+      }
+    }
+
+    inline void * malloc (size_t sz) {
+      auto& c = getCache();
+      std::lock_guard<LockType> l (c.lock);
+      return c.heap().malloc (sz);
+    }
+
+    inline void free (void * ptr) {
+      auto& c = getCache();
+      std::lock_guard<LockType> l (c.lock);
+      c.heap().free (ptr);
+    }
+
+    inline void freeSized (void * ptr, size_t sz) {
+      auto& c = getCache();
+      std::lock_guard<LockType> l (c.lock);
+      c.heap().freeSized (ptr, sz);
+    }
+
+    inline static size_t getSize (void * ptr) {
+      return CacheType::getSize (ptr);
+    }
+
+    /// Empty every CPU's cache.
+    void clear() {
+      for (auto i = 0; i < NumCPUs; i++) {
+	std::lock_guard<LockType> l (_caches[i].lock);
+	_caches[i].heap().clear();
+      }
+    }
+
+    /// @return the CPU this thread is (probably) running on.
+    static inline int getCPU() {
+      return CurrentCPU::get();
+    }
+
+  private:
+
+    /// One CPU's cache, on its own cache lines.
+    class alignas(64) Cache {
+    public:
+      LockType lock;
+      alignas(CacheType) char buf[sizeof(CacheType)];
+
+      inline CacheType& heap() {
+	return *reinterpret_cast<CacheType *>(&buf);
+      }
+    };
+
+    inline Cache& getCache() {
+      return _caches[getCPU() & (NumCPUs - 1)];
+    }
+
+    Cache _caches[NumCPUs];
+
+  };
+
+}
+
+#endif
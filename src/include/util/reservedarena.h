@@ -0,0 +1,195 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.emeryberger.com
+
+  Copyright (c) 1998-2018 Emery Berger
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+/**
+ * @file reservedarena.h
+ * @author Emery Berger <http://www.emeryberger.com>
+ */
+
+
+#ifndef HOARD_RESERVEDARENA_H
+#define HOARD_RESERVEDARENA_H
+
+#include <cassert>
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include "heaplayers.h"
+
+namespace Hoard {
+
+  /**
+   * @class ReservedArena
+   * @brief Hands out Alignment-aligned memory from one big reserved
+   *        (inaccessible, uncommitted) stretch of address space.
+   * @note  Memory is made accessible CommitSize bytes at a time, so
+   *        most requests take no system call at all, and the committed
+   *        part stays one mapping however many requests we serve.
+   * @note  When a reservation runs out, we reserve another. Memory
+   *        from here is never returned (though its pages may be
+   *        discarded).
+   * @note  If the address space is limited (e.g., by ulimit -v), we
+   *        halve the reservation until it fits, and if even CommitSize
+   *        won't, we stop asking.
+   */
+
+  template <size_t Alignment,
+	    size_t ReserveSize,
+	    size_t CommitSize,
+	    class LockType>
+  class ReservedArena {
+  public:
+
+    ReservedArena()
+      : _bump (nullptr),
+	_committed (nullptr),
+	_end (nullptr),
+	_reserveSize (ReserveSize)
+    {}
+
+    static ReservedArena& getInstance() {
+      static double buf[sizeof(ReservedArena) / sizeof(double) + 1];
+      static auto * arena = new (buf) ReservedArena;
+      return *arena;
+    }
+
+    /// @return sz bytes (a multiple of Alignment), or null if we're out
+    ///         of address space.
+    void * malloc (size_t sz) {
+      assert (sz % Alignment == 0);
+      std::lock_guard<LockType> g (_lock);
+      if ((size_t) (_end - _bump) < sz) {
+	if (!reserve (sz)) {
+	  return nullptr;
+	}
+      }
+      if ((size_t) (_committed - _bump) < sz) {
+	if (!commit (_bump + sz)) {
+	  return nullptr;
+	}
+      }
+      auto * ptr = _bump;
+      _bump += sz;
+      return ptr;
+    }
+
+  private:
+
+    static_assert(ReserveSize % CommitSize == 0,
+		  "Reservations must be a whole number of commits.");
+    static_assert(CommitSize % Alignment == 0,
+		  "Commits must keep memory aligned.");
+
+    /// Start a new reservation (abandoning what's left of the last one).
+    bool reserve (size_t sz) {
+#if defined(__linux__)
+      char * ptr;
+      size_t size;
+      for (;;) {
+	if (_reserveSize == 0) {
+	  // We've given up.
+	  return false;
+	}
+	size = _reserveSize;
+	while (size < sz) {
+	  size += _reserveSize;
+	}
+	// Over-reserve so we can trim to an aligned stretch.
+	ptr = reinterpret_cast<char *>(mmap (nullptr, size + Alignment,
+					     PROT_NONE,
+					     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+					     -1, 0));
+	if (ptr != MAP_FAILED) {
+	  break;
+	}
+	// Out of address space: ask for less from now on.
+	_reserveSize = (_reserveSize / 2 >= CommitSize) ? _reserveSize / 2 : 0;
+      }
+      auto * start = reinterpret_cast<char *>(HL::align<Alignment>((size_t) ptr));
+      const size_t prolog = start - ptr;
+      if (prolog > 0) {
+	munmap (ptr, prolog);
+      }
+      const size_t epilog = Alignment - prolog;
+      if (epilog > 0) {
+	munmap (start + size, epilog);
+      }
+      _bump = _committed = start;
+      _end = start + size;
+      return true;
+#else
+      (void) sz;
+      _reserveSize = 0;
+      return false;
+#endif
+    }
+
+    /// Make everything up to (at least) upTo accessible.
+    bool commit (char * upTo) {
+#if defined(__linux__)
+      auto * to = _committed + CommitSize;
+      while (to < upTo) {
+	to += CommitSize;
+      }
+      if (to > _end) {
+	to = _end;
+      }
+      if (mprotect (_committed, to - _committed, PROT_READ | PROT_WRITE) != 0) {
+	return false;
+      }
+      _committed = to;
+      return true;
+#else
+      (void) upTo;
+      return false;
+#endif
+    }
+
+    LockType _lock;
+
+    /// The next free byte.
+    char * _bump;
+
+    /// The end of the accessible part.
+    char * _committed;
+
+    /// The end of the current reservation.
+    char * _end;
+
+    /// How much to reserve next (0 = no more reservations).
+    size_t _reserveSize;
+
+  };
+
+}
+
+#endif
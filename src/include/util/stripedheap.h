@@ -0,0 +1,114 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.emeryberger.com
+
+  Copyright (c) 1998-2018 Emery Berger
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+#ifndef HOARD_STRIPEDHEAP_H
+#define HOARD_STRIPEDHEAP_H
+
+#include <mutex>
+
+#include "array.h"
+#include "heaplayers.h"
+
+namespace Hoard {
+
+  /**
+   * @class StripedHeap
+   * @brief Spreads threads over NumHeaps locked heaps by thread id
+   *        (like HL::ThreadHeap over HL::LockedHeap).
+   * @note  Also resizes objects, under the same lock as everything
+   *        else, so the heaps can keep their books straight.
+   */
+
+  template <int NumHeaps,
+	    class LockType,
+	    class Heap>
+  class StripedHeap {
+  public:
+
+    enum { Alignment = Heap::Alignment };
+
+    static_assert((NumHeaps & (NumHeaps - 1)) == 0,
+		  "The number of heaps must be a power of two.");
+
+    inline void * malloc (size_t sz) {
+      auto& h = getHeap();
+      std::lock_guard<LockType> g (h.lock);
+      return h.malloc (sz);
+    }
+
+    inline void free (void * ptr) {
+      auto& h = getHeap();
+      std::lock_guard<LockType> g (h.lock);
+      h.free (ptr);
+    }
+
+    inline size_t getSize (void * ptr) {
+      return getHeap().getSize (ptr);
+    }
+
+    /// @brief Resize an object without copying it (see Heap::resize).
+    /// @return its (possibly new) address, or null if it must be copied.
+    inline void * resize (void * ptr, size_t sz) {
+      auto& h = getHeap();
+      std::lock_guard<LockType> g (h.lock);
+      return h.resize (ptr, sz);
+    }
+
+    /// Have every heap give back its surplus.
+    void scavenge() {
+      for (int i = 0; i < NumHeaps; i++) {
+	std::lock_guard<LockType> g (_heaps(i).lock);
+	_heaps(i).scavenge();
+      }
+    }
+
+    /// Have every heap give back everything it caches.
+    void clear() {
+      for (int i = 0; i < NumHeaps; i++) {
+	std::lock_guard<LockType> g (_heaps(i).lock);
+	_heaps(i).clear();
+      }
+    }
+
+  private:
+
+    class Stripe : public Heap {
+    public:
+      LockType lock;
+    };
+
+    inline Stripe& getHeap() {
+      return _heaps((int) (HL::CPUInfo::getThreadId() & (NumHeaps - 1)));
+    }
+
+    Array<NumHeaps, Stripe> _heaps;
+
+  };
+
+}
+
+#endif
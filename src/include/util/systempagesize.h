@@ -0,0 +1,87 @@
+// -*- C++ -*-
+
+/*
+
+  The Hoard Multiprocessor Memory Allocator
+  www.hoard.org
+
+  Author: Emery Berger, http://www.emeryberger.com
+
+  Copyright (c) 1998-2018 Emery Berger
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+
+#ifndef HOARD_SYSTEMPAGESIZE_H
+#define HOARD_SYSTEMPAGESIZE_H
+
+#include <atomic>
+#include <cstddef>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace Hoard {
+
+  /**
+   * @class SystemPageSize
+   * @brief The page size of the machine we're running on, which may be
+   *        larger than the one we were built for (e.g., 16K or 64K on
+   *        some ARM systems).
+   */
+
+  class SystemPageSize {
+  public:
+
+    /// @return the page size, in bytes (always a power of two).
+    static inline size_t get() {
+      static std::atomic<size_t> pageSize (0);
+      auto sz = pageSize.load (std::memory_order_relaxed);
+      if (sz == 0) {
+	// Racing threads all find the same answer.
+	sz = query();
+	pageSize.store (sz, std::memory_order_relaxed);
+      }
+      return sz;
+    }
+
+    /// @return sz, rounded up to a whole number of pages.
+    static inline size_t roundUp (size_t sz) {
+      const auto pageSize = get();
+      return (sz + pageSize - 1) & ~(pageSize - 1);
+    }
+
+  private:
+
+    static size_t query() {
+#if defined(_WIN32)
+      SYSTEM_INFO info;
+      GetSystemInfo (&info);
+      return info.dwPageSize;
+#else
+      const long sz = sysconf (_SC_PAGESIZE);
+      return (sz > 0) ? (size_t) sz : 4096;
+#endif
+    }
+
+  };
+
+}
+
+#endif
@@ -28,6 +28,7 @@
 #ifndef HOARD_THREADPOOLHEAP_H
 #define HOARD_THREADPOOLHEAP_H
 
+#include <atomic>
 #include <cassert>
 
 #include "heaplayers.h"
@@ -36,6 +37,18 @@
 
 namespace Hoard {
 
+  /**
+   * @class ThreadPoolHeap
+   * @brief A pool of heaps, shared among threads.
+   * @note  The pool holds two heaps per CPU (up to NumHeaps), and each
+   *        heap is only built when a thread first claims it, so small
+   *        processes touch just the memory they use.
+   * @note  On Linux, each thread keeps the index of its heap in
+   *        thread-local storage, so any number of threads can have
+   *        heaps of their own. Elsewhere, threads are hashed (by id)
+   *        into a map of NumThreads entries.
+   */
+
   template <int NumThreads,
 	    int NumHeaps,
 	    class PerThreadHeap_>
@@ -46,75 +59,201 @@ namespace Hoard {
     
     enum { MaxThreads = NumThreads };
     enum { NumThreadsMask = NumThreads - 1};
-    enum { NumHeapsMask = NumHeaps - 1};
     
     enum { MaxHeaps = NumHeaps };
     
     ThreadPoolHeap()
+      : _numHeaps (computeNumHeaps())
     {
-      static_assert((NumHeaps & NumHeapsMask) == 0,
-		    "Number of heaps must be a power of two.");
       static_assert((NumThreads & NumThreadsMask) == 0,
 		    "Number of threads must be a power of two.");
+      static_assert(NumHeaps <= 256,
+		    "Heap indices must fit in a byte.");
     
-      // Note: The tidmap values should be set externally.
-      int j = 0;
+#if !defined(__linux__)
       for (int i = 0; i < NumThreads; i++) {
-	setTidMap(i, j % NumHeaps);
-	j++;
+	_tidMap(i) = 0;
+      }
+#endif
+      for (int i = 0; i < NumHeaps; i++) {
+	_built(i).store (NotBuilt, std::memory_order_relaxed);
       }
+      // Every thread starts out on heap 0.
+      buildHeap (0);
     }
     
     inline PerThreadHeap& getHeap (void) {
-      auto tid = HL::CPUInfo::getThreadId();
-      auto heapno = _tidMap(tid & NumThreadsMask);
-      return _heap(heapno);
+      return heap (getThreadHeap());
     }
     
     inline void * malloc (size_t sz) {
       return getHeap().malloc (sz);
     }
     
+    inline unsigned int mallocBatch (size_t sz, void ** ptrs, unsigned int n) {
+      return getHeap().mallocBatch (sz, ptrs, n);
+    }
+    
     inline void free (void * ptr) {
       getHeap().free (ptr);
     }
     
+    inline void freeBatch (void ** ptrs, unsigned int n) {
+      getHeap().freeBatch (ptrs, n);
+    }
+    
     inline void clear() {
       getHeap().clear();
     }
+
+    /// Does the calling thread's heap own the given superblock?
+    template <class SuperblockType>
+    inline bool owns (SuperblockType * s) {
+      return getHeap().owns (s);
+    }
+    
+    /// Have every heap return its surplus memory.
+    void scavenge() {
+      for (int i = 0; i < _numHeaps; i++) {
+	if (isBuilt (i)) {
+	  heap(i).scavenge();
+	}
+      }
+    }
     
     inline size_t getSize (void * ptr) {
       return PerThreadHeap::getSize (ptr);
     }
-    
-    void setTidMap (int index, int value) {
-      assert ((value >= 0) && (value < MaxHeaps));
-      _tidMap(index) = value;
+
+    /// The number of heaps threads may use (at most MaxHeaps).
+    inline int getNumHeaps() const {
+      return _numHeaps;
     }
     
-    int getTidMap (int index) const {
-      return _tidMap(index); 
+    /// Assign the calling thread to heap index.
+    void setThreadHeap (int index) {
+      assert ((index >= 0) && (index < _numHeaps));
+      assert (isBuilt (index));
+#if defined(__linux__)
+      threadHeap() = (unsigned char) index;
+#else
+      _tidMap(HL::CPUInfo::getThreadId() & NumThreadsMask) = (unsigned char) index;
+#endif
+    }
+
+    /// @return the index of the calling thread's heap (0 until assigned).
+    inline int getThreadHeap() {
+#if defined(__linux__)
+      return threadHeap();
+#else
+      return _tidMap(HL::CPUInfo::getThreadId() & NumThreadsMask);
+#endif
     }
     
     void setInusemap (int index, int value) {
-      _inUseMap(index) = value;
+      _inUseMap(index).store (value, std::memory_order_relaxed);
     }
     
     int getInusemap (int index) const {
-      return _inUseMap(index);
+      return _inUseMap(index).load (std::memory_order_relaxed);
+    }
+
+    /// Add a thread to heap index, if it still has exactly users
+    /// threads. Builds the heap if need be.
+    bool claimHeap (int index, int users) {
+      if (!_inUseMap(index).compare_exchange_strong (users, users + 1,
+						     std::memory_order_relaxed)) {
+	return false;
+      }
+      buildHeap (index);
+      return true;
+    }
+
+    /// Take a thread off heap index.
+    void unclaimHeap (int index) {
+      auto users = getInusemap (index);
+      // Never go below zero (e.g., on a mismatched release).
+      while ((users > 0) &&
+	     !_inUseMap(index).compare_exchange_weak (users, users - 1,
+						      std::memory_order_relaxed))
+	;
+    }
+
+    /// How many times threads have had to wait for heap index.
+    unsigned int getContention (int index) const {
+      if (!isBuilt (index)) {
+	return 0;
+      }
+      return heap(index).getContention();
     }
     
     
   private:
+
+    enum { NotBuilt = 0, Building = 1, Built = 2 };
+
+    /// Two heaps per CPU (as in the original Hoard), rounded up to a
+    /// power of two.
+    static int computeNumHeaps() {
+      auto cpus = HL::CPUInfo::computeNumProcessors();
+      auto n = 1;
+      while ((n < 2 * cpus) && (n < NumHeaps)) {
+	n *= 2;
+      }
+      return n;
+    }
+
+    inline bool isBuilt (int index) const {
+      return (_built(index).load (std::memory_order_acquire) == Built);
+    }
+
+    /// Construct heap index, unless someone already has.
+    void buildHeap (int index) {
+      auto state = (int) NotBuilt;
+      if (_built(index).compare_exchange_strong (state, Building,
+						 std::memory_order_acquire)) {
+	new (&_heapBuf[index][0]) PerThreadHeap;
+	_built(index).store (Built, std::memory_order_release);
+	return;
+      }
+      // Someone else is building it: wait until they're done.
+      while (!isBuilt (index)) {
+	HL::Fred::yield();
+      }
+    }
+
+#if defined(__linux__)
+    static inline unsigned char& threadHeap() {
+      // Initial-exec TLS never allocates (so it can't recurse into malloc).
+      static __thread unsigned char index __attribute__((tls_model ("initial-exec")));
+      return index;
+    }
+#endif
+
+    inline PerThreadHeap& heap (int index) {
+      return *reinterpret_cast<PerThreadHeap *>(&_heapBuf[index][0]);
+    }
+
+    inline const PerThreadHeap& heap (int index) const {
+      return *reinterpret_cast<const PerThreadHeap *>(&_heapBuf[index][0]);
+    }
+
+    /// How many heaps we use.
+    const int _numHeaps;
     
+#if !defined(__linux__)
     /// Which heap is assigned to which thread, indexed by thread.
-    Array<MaxThreads, int> _tidMap;
+    Array<MaxThreads, unsigned char> _tidMap;
+#endif
     
-    /// Which heap is in use (a reference count).
-    Array<MaxHeaps, int> _inUseMap;
+    /// How many threads use each heap.
+    Array<MaxHeaps, std::atomic<int> > _inUseMap;
+
+    /// Whether each heap has been constructed yet.
+    Array<MaxHeaps, std::atomic<int> > _built;
     
-    /// The array of heaps we choose from.
-    Array<MaxHeaps, PerThreadHeap> _heap;
+    /// Room for the heaps we choose from, constructed on demand.
+    double _heapBuf[MaxHeaps][sizeof(PerThreadHeap) / sizeof(double) + 1];
     
   };
   
@@ -30,7 +30,9 @@
  * @author Emery Berger <http://www.cs.umass.edu/~emery>
  */
 
+#include <atomic>
 #include <cstddef>
+#include <cstring>
 #include <new>
 
 #include "VERSION.h"
@@ -89,12 +91,34 @@ namespace Hoard {
 } // namespace Hoard
 
 #include "hoardtlab.h"
+#include "bootstrapheap.h"
 
 //
 // The base Hoard heap.
 //
 
 
+/// How much address space we set aside for allocations made before
+/// the main heap is up (in practice, well under 1MB gets used).
+enum { BootstrapReserveSize = 4 * 1024 * 1024 };
+
+/// Serves allocations made before the main heap is up.
+static Hoard::BootstrapHeap<BootstrapReserveSize> theBootstrapHeap;
+
+/// Is the main heap up (so any thread can make its own TLAB)?
+static std::atomic<bool> mainHeapReady (false);
+
+/// The main heap is up: hand off to it from the bootstrap heap.
+static void handOff() {
+  if (mainHeapReady.exchange (true)) {
+    return;
+  }
+  theBootstrapHeap.trim();
+#if !defined(_WIN32)
+  fprintf(stderr, versionMessage);
+#endif
+}
+
 /// Maintain a single instance of the main Hoard heap.
 
 Hoard::HoardHeapType * getMainHoardHeap() {
@@ -106,55 +130,150 @@ Hoard::HoardHeapType * getMainHoardHeap() {
 
   // Now initialize the heap into that buffer.
   static auto * th = new (thBuf) Hoard::HoardHeapType;
+
+  // (Outside the initializer, since anything we call from here on may
+  // allocate.)
+  if (!mainHeapReady.load (std::memory_order_relaxed)) {
+    handOff();
+  }
   return th;
 }
 
 TheCustomHeapType * getCustomHeap();
 
-enum { MAX_LOCAL_BUFFER_SIZE = 256 * 131072 };
-static char initBuffer[MAX_LOCAL_BUFFER_SIZE];
-static char * initBufferPtr = initBuffer;
-
 extern bool isCustomHeapInitialized();
 
+/// @return sz bytes, or null if we're out of memory.
+static void * tryMalloc (size_t sz) {
+  // Until the main heap is up, satisfy memory requests from the
+  // bootstrap heap. After that, a thread without a TLAB just makes one.
+  if (!isCustomHeapInitialized() && !mainHeapReady.load (std::memory_order_relaxed)) {
+    auto * ptr = theBootstrapHeap.malloc (sz);
+    if (ptr) {
+      return ptr;
+    }
+    // Out of room (or we just handed off): use the main heap after all.
+  }
+  return getCustomHeap()->malloc (sz);
+}
+
 extern "C" {
 
   void * xxmalloc (size_t sz) {
-    if (isCustomHeapInitialized()) {
-      void * ptr = getCustomHeap()->malloc (sz);
-      if (ptr == nullptr) {
-	fprintf(stderr, "INTERNAL FAILURE.\n");
-	abort();
-      }
-      return ptr;
-    }
-    // We still haven't initialized the heap. Satisfy this memory
-    // request from the local buffer.
-    void * ptr = initBufferPtr;
-    initBufferPtr += sz;
-    if (initBufferPtr > initBuffer + MAX_LOCAL_BUFFER_SIZE) {
+    void * ptr = tryMalloc (sz);
+    if (ptr == nullptr) {
+      fprintf(stderr, "INTERNAL FAILURE.\n");
       abort();
     }
-    {
-      static bool initialized = false;
-      if (!initialized) {
-	initialized = true;
-#if !defined(_WIN32)
-	fprintf(stderr, versionMessage);
-#endif
-      }
-    }
     return ptr;
   }
 
   void xxfree (void * ptr) {
+    if (theBootstrapHeap.contains (ptr)) {
+      // Bootstrap objects are never reused.
+      return;
+    }
     getCustomHeap()->free (ptr);
   }
 
+  /// Free an object of (at most) size sz, as allocated by xxmalloc.
+  void xxfree_sized (void * ptr, size_t sz) {
+    if ((ptr == nullptr) || theBootstrapHeap.contains (ptr)) {
+      // Nothing to do, or it came from the bootstrap heap.
+      return;
+    }
+    getCustomHeap()->freeSized (ptr, sz);
+  }
+
   size_t xxmalloc_usable_size (void * ptr) {
+    if (theBootstrapHeap.contains (ptr)) {
+      return theBootstrapHeap.getSize (ptr);
+    }
     return getCustomHeap()->getSize (ptr);
   }
 
+  /// Resize an object. Large objects grow and shrink by remapping
+  /// their pages, rather than by copying them.
+  /// @return null if we're out of memory (leaving ptr as it was).
+  void * xxrealloc (void * ptr, size_t sz) {
+    if (ptr == nullptr) {
+      return xxmalloc (sz);
+    }
+    if (sz == 0) {
+      xxfree (ptr);
+      return nullptr;
+    }
+    if (theBootstrapHeap.contains (ptr)) {
+      // From the bootstrap heap: always move it to the real one.
+      auto * buf = tryMalloc (sz);
+      if (buf == nullptr) {
+	return nullptr;
+      }
+      auto oldSize = theBootstrapHeap.getSize (ptr);
+      memcpy (buf, ptr, (oldSize < sz) ? oldSize : sz);
+      return buf;
+    }
+    auto oldSize = xxmalloc_usable_size (ptr);
+    // Objects never cross between the small and big heaps in place.
+    const bool wasBig = (oldSize > Hoard::BigObjectSize);
+    const bool isBig = (sz > Hoard::BigObjectSize);
+    if (wasBig && isBig &&
+	(((size_t) ptr - sizeof(Hoard::TheHeader)) % SUPERBLOCK_SIZE == 0)) {
+      // A large object that starts its mapping (i.e., not an aligned
+      // pointer into one).
+      auto * buf = Hoard::BigHeap::resize (ptr, sz);
+      if (buf) {
+	return buf;
+      }
+    }
+    if ((wasBig == isBig) && (oldSize >= sz) && (oldSize / 2 < sz)) {
+      // Shrinking a little: keep it where it is.
+      return ptr;
+    }
+    auto * buf = tryMalloc (sz);
+    if (buf == nullptr) {
+      return nullptr;
+    }
+    memcpy (buf, ptr, (oldSize < sz) ? oldSize : sz);
+    xxfree (ptr);
+    return buf;
+  }
+
+  /// Ask every thread to give back the memory it isn't using.
+  /// Idle per-thread heaps are trimmed now; thread-local buffers
+  /// trim themselves on their next allocation. Empty superblocks in
+  /// the global heap, and cached large objects, go back to the OS
+  /// right away.
+  void hoard_trim() {
+    Hoard::TrimEpoch::advance();
+    if (isCustomHeapInitialized()) {
+      getCustomHeap()->clear();
+    }
+    getMainHoardHeap()->scavenge();
+    // Everything that's empty now goes back to the OS, and so do the
+    // large objects we cached.
+    Hoard::TheGlobalHeap::purge (0);
+    Hoard::BigHeap::clear();
+  }
+
+  /// @brief Set how long superblocks sit empty before their memory
+  ///        goes back to the OS, in milliseconds (negative = never).
+  void hoard_set_purge_delay (long ms) {
+    Hoard::PurgePolicy::setDelay (ms);
+  }
+
+  /// @brief Set when per-thread heaps give back superblocks of objects
+  ///        of size sz (0 = every size); see thresholdpolicy.h.
+  /// @return 0 on success, -1 if the settings are out of range.
+  int hoard_set_release_threshold (size_t sz, unsigned int fullness, unsigned int slack) {
+    return Hoard::TheThresholdPolicy::getInstance().setThreshold (sz, fullness, slack) ? 0 : -1;
+  }
+
+  /// Cap the memory each per-thread heap retains, in bytes (0 = no cap).
+  void hoard_set_max_heap_bytes (size_t bytes) {
+    Hoard::TheThresholdPolicy::getInstance().setMaxHeapBytes (bytes);
+  }
+
   void xxmalloc_lock() {
     // Undefined for Hoard.
   }
@@ -164,3 +283,61 @@ extern "C" {
   }
 
 } // namespace Hoard
+
+#if !defined(_WIN32)
+
+// Sized deallocation (C++14 sized delete, C23 free_sized), which the
+// Heap-Layers wrappers don't provide. Knowing the size lets us skip
+// the superblock header lookup. Also realloc, which can do better
+// than the wrappers' malloc-copy-free for large objects.
+
+extern "C" {
+
+#if defined(__GLIBC__)
+  // This assumes Heap-Layers' GNU wrapper defines realloc weakly, if
+  // at all, so ours is weak too: a wrapper that defines realloc
+  // outright keeps its own. Between two weak definitions the linker
+  // takes the first, and GNU_SRC (see GNUmakefile) lists this file
+  // before the wrapper.
+  void * realloc (void * ptr, size_t sz) __THROW __attribute__((weak));
+
+  void * realloc (void * ptr, size_t sz) __THROW {
+    return xxrealloc (ptr, sz);
+  }
+#endif
+
+  void free_sized (void * ptr, size_t sz) noexcept {
+    xxfree_sized (ptr, sz);
+  }
+
+  void free_aligned_sized (void * ptr, size_t alignment, size_t sz) noexcept {
+    if (alignment <= HL::MallocInfo::Alignment) {
+      xxfree_sized (ptr, sz);
+    } else {
+      // Over-aligned objects may not start where their block does.
+      xxfree (ptr);
+    }
+  }
+
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+// The unsized operator deletes live in the wrapper.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsized-deallocation"
+#endif
+
+void operator delete (void * ptr, size_t sz) noexcept {
+  xxfree_sized (ptr, sz);
+}
+
+void operator delete[] (void * ptr, size_t sz) noexcept {
+  xxfree_sized (ptr, sz);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif
+
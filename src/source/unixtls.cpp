@@ -61,15 +61,62 @@
 #include <dlfcn.h>
 #endif
 
+#include <atomic>
+#include <ctime>
 #include <new>
 #include <utility>
 
+#include <sched.h>
+
 
 #include "hoard/hoardtlab.h"
 
 extern Hoard::HoardHeapType * getMainHoardHeap();
 
-#if defined(USE_THREAD_KEYWORD)
+#if HOARD_PER_CPU_CACHE
+
+// Every thread shares the same set of per-CPU caches.
+
+// (Each cache is aligned to its own cache lines, so the buffer must be too.)
+alignas(TheCustomHeapType) static char cacheBuffer[sizeof(TheCustomHeapType)];
+static std::atomic<TheCustomHeapType *> theCaches (nullptr);
+
+static TheCustomHeapType * initializeCustomHeap() __attribute__((constructor));
+
+static TheCustomHeapType * initializeCustomHeap() {
+  auto caches = theCaches.load (std::memory_order_acquire);
+  if (caches != nullptr) {
+    return caches;
+  }
+  // Set up the main heap first, since that may allocate; building
+  // the caches themselves doesn't.
+  auto * mainHeap = getMainHoardHeap();
+  static std::atomic<bool> claimed (false);
+  if (!claimed.exchange (true, std::memory_order_acq_rel)) {
+    caches = new (cacheBuffer) TheCustomHeapType (mainHeap);
+    theCaches.store (caches, std::memory_order_release);
+    return caches;
+  }
+  // Another thread got here first: wait for it to finish.
+  while ((caches = theCaches.load (std::memory_order_acquire)) == nullptr) {
+    sched_yield();
+  }
+  return caches;
+}
+
+bool isCustomHeapInitialized() {
+  return (theCaches.load (std::memory_order_relaxed) != nullptr);
+}
+
+TheCustomHeapType * getCustomHeap() {
+  auto caches = theCaches.load (std::memory_order_acquire);
+  if (caches == nullptr) {
+    caches = initializeCustomHeap();
+  }
+  return caches;
+}
+
+#elif defined(USE_THREAD_KEYWORD)
 
 // Thread-specific buffers and pointers to hold the TLAB.
 
@@ -200,15 +247,18 @@ extern "C" {
 
 // A special routine we call on thread exit to free up some resources.
 static void exitRoutine() {
+#if HOARD_PER_CPU_CACHE
+  // The per-CPU caches outlive any one thread.
+#else
+  // Clear the heap (via its destructor).
   auto * heap = initializeCustomHeap();
+  heap->~TheCustomHeapType();
+#endif
 
-  // Relinquish the assigned heap.
+  // Relinquish the assigned heap (now that we're done freeing into it).
   getMainHoardHeap()->releaseHeap();
 
-  // Clear the heap (via its destructor).
-  heap->~TheCustomHeapType();
-
-#if !defined(USE_THREAD_KEYWORD)
+#if !HOARD_PER_CPU_CACHE && !defined(USE_THREAD_KEYWORD)
   // Reclaim the memory associated with the heap (thread-specific data).
   pthread_key_delete (theHeapKey);
 #endif
@@ -384,6 +434,38 @@ extern "C" int pthread_create (pthread_t *thread,
   return result;
 }
 
+//
+// An optional housekeeping thread (HOARD_PURGE_THREAD=1) that purges
+// long-empty superblocks, and lets go of large objects cached for an
+// old peak, even when the heaps see no traffic.
+//
+
+static void * purgeLoop (void *) {
+  for (;;) {
+    auto ms = Hoard::PurgePolicy::getInterval();
+    struct timespec ts;
+    ts.tv_sec = (time_t) (ms / 1000);
+    ts.tv_nsec = (long) (ms % 1000) * 1000000L;
+    nanosleep (&ts, nullptr);
+    Hoard::TheGlobalHeap::purgeExpired();
+    Hoard::BigHeap::scavenge();
+  }
+  return nullptr;
+}
+
+// NB: This must come after initTSD (above).
+static void startPurgeThread() __attribute__((constructor));
+
+static void startPurgeThread() {
+  auto * env = getenv ("HOARD_PURGE_THREAD");
+  if (env && (atoi (env) != 0)) {
+    pthread_t t;
+    if (pthread_create (&t, nullptr, purgeLoop, nullptr) == 0) {
+      pthread_detach (t);
+    }
+  }
+}
+
 #if defined(__clang__)
 #pragma clang diagnostic pop
 #endif
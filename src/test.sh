@@ -6,3 +6,6 @@ LD_PRELOAD=../src/libhoard.so ../benchmarks/larson/larson 10 7 8 10000 1000 1 4
 cd ../src/test
 make
 LD_PRELOAD=../libhoard.so ./mtest
+LD_PRELOAD=../libhoard.so ./testtrim
+LD_PRELOAD=../libhoard.so ./testrealloc
+LD_PRELOAD=../libhoard.so ./testidle
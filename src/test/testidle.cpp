@@ -0,0 +1,149 @@
+// Idle threads: memory that parked threads hold in their thread-local
+// buffers and heaps goes back on hoard_trim(), and the threads carry
+// on as before when they wake up.
+//
+// Run with Hoard preloaded, e.g.:
+//   LD_PRELOAD=../libhoard.so ./testidle
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+using namespace std;
+
+enum { Threads = 16 };
+enum { Objects = 40000 };
+enum { Kept = 1000 };
+enum { MaxObjectSize = 256 };
+
+static mutex parkLock;
+static condition_variable parked;
+static condition_variable resumed;
+static int numParked = 0;
+static bool wakeUp = false;
+
+/// @return this process's resident set size, in bytes.
+static size_t residentBytes() {
+  long pages = 0, resident = 0;
+  auto * f = fopen ("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf (f, "%ld %ld", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    fclose (f);
+  }
+  return (size_t) resident * (size_t) sysconf (_SC_PAGESIZE);
+}
+
+static void fill (char * ptr, size_t sz, char c) {
+  memset (ptr, c, sz);
+}
+
+static void check (const char * ptr, char c) {
+  const size_t sz = *reinterpret_cast<const size_t *>(ptr);
+  for (size_t i = sizeof(size_t); i < sz; i++) {
+    if (ptr[i] != c) {
+      fprintf (stderr, "testidle: object %p corrupted at offset %zu.\n", ptr, i);
+      abort();
+    }
+  }
+}
+
+/// Allocate a lot, free most of it, and keep the first few objects
+/// live (so the rest of their superblocks can empty out). Each object
+/// starts with its size.
+static void churn (vector<char *>& kept, char c, unsigned int& seed) {
+  vector<char *> objs;
+  objs.reserve (Objects);
+  for (int i = 0; i < Objects; i++) {
+    const size_t sz = sizeof(size_t) + (size_t) rand_r (&seed) % MaxObjectSize;
+    auto * ptr = reinterpret_cast<char *>(malloc (sz));
+    *reinterpret_cast<size_t *>(ptr) = sz;
+    fill (ptr + sizeof(size_t), sz - sizeof(size_t), c);
+    objs.push_back (ptr);
+  }
+  for (int i = 0; i < Objects; i++) {
+    if (i < Kept) {
+      kept.push_back (objs[i]);
+    } else {
+      free (objs[i]);
+    }
+  }
+}
+
+static void worker (int id) {
+  unsigned int seed = (unsigned int) id + 1;
+  const char c = (char) ('a' + id);
+  vector<char *> kept;
+  kept.reserve (Kept);
+  churn (kept, c, seed);
+  // Park, holding on to whatever the allocator cached for us.
+  {
+    unique_lock<mutex> g (parkLock);
+    numParked++;
+    parked.notify_one();
+    resumed.wait (g, [] { return wakeUp; });
+  }
+  // Our first allocation after the trim empties our buffer; all our
+  // objects must have survived it.
+  for (auto * ptr : kept) {
+    check (ptr, c);
+  }
+  vector<char *> more;
+  churn (more, c, seed);
+  for (auto * ptr : kept) {
+    free (ptr);
+  }
+  for (auto * ptr : more) {
+    free (ptr);
+  }
+}
+
+int main() {
+  auto trim = reinterpret_cast<void (*)()>(dlsym (RTLD_DEFAULT, "hoard_trim"));
+  if (!trim) {
+    printf ("testidle: hoard_trim not found (run with Hoard preloaded).\n");
+    return 1;
+  }
+  // Never purge on our own, so whatever goes back to the OS is what
+  // the trim scavenged.
+  auto setDelay = reinterpret_cast<void (*)(long)>(dlsym (RTLD_DEFAULT, "hoard_set_purge_delay"));
+  if (setDelay) {
+    setDelay (-1);
+  }
+  vector<thread> threads;
+  for (int i = 0; i < Threads; i++) {
+    threads.emplace_back (worker, i);
+  }
+  {
+    unique_lock<mutex> g (parkLock);
+    parked.wait (g, [] { return numParked == Threads; });
+  }
+  const auto before = residentBytes();
+  trim();
+  const auto after = residentBytes();
+  printf ("testidle: resident %zu KB with all threads idle, %zu KB after trimming.\n",
+	  before / 1024, after / 1024);
+  fflush (stdout);
+  if (after >= before) {
+    fprintf (stderr, "testidle: trimming gave nothing back.\n");
+    abort();
+  }
+  {
+    lock_guard<mutex> g (parkLock);
+    wakeUp = true;
+  }
+  resumed.notify_all();
+  for (auto& t : threads) {
+    t.join();
+  }
+  printf ("testidle: ok\n");
+  return 0;
+}
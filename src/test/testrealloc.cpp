@@ -0,0 +1,106 @@
+// Test realloc: growing and shrinking small and large objects (in
+// place or not), and running out of memory.
+//
+// Run with Hoard preloaded, e.g.:
+//   LD_PRELOAD=../libhoard.so ./testrealloc
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <malloc.h>
+
+using namespace std;
+
+static void fail (const char * what, size_t sz) {
+  fprintf (stderr, "testrealloc: %s (size %zu).\n", what, sz);
+  abort();
+}
+
+static void fill (char * ptr, size_t sz, char c) {
+  memset (ptr, c, sz);
+}
+
+static void check (const char * ptr, size_t sz, char c) {
+  for (size_t i = 0; i < sz; i++) {
+    if (ptr[i] != c) {
+      fail ("contents lost", sz);
+    }
+  }
+}
+
+/// Walk one object through a series of sizes, checking what it holds.
+static void resizeThrough (const vector<size_t>& sizes, char c) {
+  size_t sz = sizes[0];
+  auto * ptr = reinterpret_cast<char *>(malloc (sz));
+  fill (ptr, sz, c);
+  for (auto next : sizes) {
+    auto * q = reinterpret_cast<char *>(realloc (ptr, next));
+    if (q == nullptr) {
+      fail ("realloc failed", next);
+    }
+    if (malloc_usable_size (q) < next) {
+      fail ("object too small", next);
+    }
+    check (q, (sz < next) ? sz : next, c);
+    fill (q, next, c);
+    ptr = q;
+    sz = next;
+  }
+  free (ptr);
+}
+
+int main() {
+  const size_t K = 1024;
+  const size_t M = 1024 * K;
+
+  // Small objects, and across the small/large boundary.
+  resizeThrough ({ 8, 24, 100, 1000, 7 * K, 8 * K, 9 * K, 100 * K, 10, 5 }, 'a');
+
+  // Large objects: grow and shrink (in place, or by remapping).
+  resizeThrough ({ 256 * K, 300 * K, 2 * M, 64 * M, 3 * M, 129 * K, 40 * M, 64 }, 'b');
+
+  // Keep the neighbors in place, so growing has to move.
+  {
+    vector<void *> blocks;
+    for (int i = 0; i < 16; i++) {
+      blocks.push_back (malloc (1 * M));
+    }
+    resizeThrough ({ 1 * M, 2 * M, 4 * M, 8 * M }, 'c');
+    for (auto * p : blocks) {
+      free (p);
+    }
+  }
+
+  // Many threads resizing large objects at once.
+  {
+    vector<thread> threads;
+    for (int t = 0; t < 8; t++) {
+      threads.emplace_back ([t, M] {
+	  for (int i = 0; i < 50; i++) {
+	    resizeThrough ({ 1 * M, (size_t) (2 + i % 7) * M, 300 * 1024, 5 * M }, (char) ('d' + t));
+	  }
+	});
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+
+  // Out of memory: realloc returns null and leaves the object alone.
+  const size_t huge = (size_t) 1 << 60;
+  for (auto sz : { (size_t) 100, 1 * M }) {
+    auto * ptr = reinterpret_cast<char *>(malloc (sz));
+    fill (ptr, sz, 'z');
+    if (realloc (ptr, huge) != nullptr) {
+      fail ("huge realloc succeeded", sz);
+    }
+    check (ptr, sz, 'z');
+    free (ptr);
+  }
+
+  printf ("testrealloc: ok\n");
+  return 0;
+}
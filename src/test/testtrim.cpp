@@ -0,0 +1,155 @@
+// Stress test: objects freed by threads other than the ones that
+// allocated them, while another thread keeps calling hoard_trim().
+//
+// Run with Hoard preloaded, e.g.:
+//   LD_PRELOAD=../libhoard.so ./testtrim
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+using namespace std;
+
+enum { Producers = 4 };
+enum { Consumers = 4 };
+enum { Rounds = 400 };
+enum { BatchSize = 512 };
+enum { MaxObjectSize = 512 };
+
+static mutex queueLock;
+static vector<vector<char *> > queue;
+static atomic<int> producersLeft (Producers);
+static atomic<bool> done (false);
+
+/// @return this process's resident set size, in bytes.
+static size_t residentBytes() {
+  long pages = 0, resident = 0;
+  auto * f = fopen ("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf (f, "%ld %ld", &pages, &resident) != 2) {
+      resident = 0;
+    }
+    fclose (f);
+  }
+  return (size_t) resident * (size_t) sysconf (_SC_PAGESIZE);
+}
+
+static char patternOf (char * ptr) {
+  return (char) ((size_t) ptr >> 4);
+}
+
+static void check (char * ptr) {
+  const size_t sz = *reinterpret_cast<size_t *>(ptr);
+  for (size_t i = sizeof(size_t); i < sz; i++) {
+    if (ptr[i] != patternOf (ptr)) {
+      fprintf (stderr, "testtrim: object %p corrupted at offset %zu.\n", ptr, i);
+      abort();
+    }
+  }
+}
+
+static void produce (unsigned int seed) {
+  for (int r = 0; r < Rounds; r++) {
+    vector<char *> batch;
+    batch.reserve (BatchSize);
+    for (int i = 0; i < BatchSize; i++) {
+      const size_t sz = sizeof(size_t) + (size_t) rand_r (&seed) % MaxObjectSize;
+      auto * ptr = reinterpret_cast<char *>(malloc (sz));
+      *reinterpret_cast<size_t *>(ptr) = sz;
+      memset (ptr + sizeof(size_t), patternOf (ptr), sz - sizeof(size_t));
+      batch.push_back (ptr);
+    }
+    lock_guard<mutex> g (queueLock);
+    queue.push_back (std::move (batch));
+  }
+  producersLeft--;
+}
+
+static void consume() {
+  for (;;) {
+    vector<char *> batch;
+    {
+      lock_guard<mutex> g (queueLock);
+      if (!queue.empty()) {
+	batch = std::move (queue.back());
+	queue.pop_back();
+      } else if (producersLeft == 0) {
+	return;
+      }
+    }
+    for (auto * ptr : batch) {
+      check (ptr);
+      free (ptr);
+    }
+    if (batch.empty()) {
+      this_thread::yield();
+    }
+  }
+}
+
+int main() {
+  auto trim = reinterpret_cast<void (*)()>(dlsym (RTLD_DEFAULT, "hoard_trim"));
+  if (!trim) {
+    printf ("testtrim: hoard_trim not found (run with Hoard preloaded).\n");
+    return 1;
+  }
+  // Zero delay, so every trim purges everything that is empty.
+  auto setDelay = reinterpret_cast<void (*)(long)>(dlsym (RTLD_DEFAULT, "hoard_set_purge_delay"));
+  if (setDelay) {
+    setDelay (0);
+  }
+  vector<thread> threads;
+  for (int i = 0; i < Producers; i++) {
+    threads.emplace_back (produce, (unsigned int) i + 1);
+  }
+  for (int i = 0; i < Consumers; i++) {
+    threads.emplace_back (consume);
+  }
+  thread trimmer ([&] {
+      while (!done) {
+	trim();
+      }
+    });
+  for (auto& t : threads) {
+    t.join();
+  }
+  done = true;
+  trimmer.join();
+  // Everything should still work afterwards.
+  for (int i = 0; i < 100000; i++) {
+    auto * ptr = reinterpret_cast<char *>(malloc (64));
+    memset (ptr, 0, 64);
+    free (ptr);
+  }
+  // Large objects freed just now stay cached (for a while), but a trim
+  // gives them back.
+  {
+    enum { LargeObjects = 64 };
+    const size_t sz = 2 * 1024 * 1024;
+    vector<char *> objs;
+    for (int i = 0; i < LargeObjects; i++) {
+      objs.push_back (reinterpret_cast<char *>(malloc (sz)));
+      memset (objs.back(), 1, sz);
+    }
+    for (auto * ptr : objs) {
+      free (ptr);
+    }
+    const auto before = residentBytes();
+    trim();
+    const auto after = residentBytes();
+    if (after + LargeObjects / 2 * sz > before) {
+      fprintf (stderr, "testtrim: trimming kept large objects (%zu KB resident, then %zu KB).\n",
+	       before / 1024, after / 1024);
+      abort();
+    }
+  }
+  printf ("testtrim: ok\n");
+  return 0;
+}